@@ -0,0 +1,210 @@
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+#include <list>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <type_traits>
+
+// 任务被取消时，future中保存的异常
+class TaskCancelled : public std::runtime_error
+{
+public:
+    TaskCancelled() : std::runtime_error("task cancelled") {}
+};
+
+// 取消令牌：可以拷贝给多个任务，同一个令牌下的任务作为一组被取消
+// 正在执行的任务可以通过isCancelled()轮询
+class CancellationToken
+{
+public:
+    CancellationToken() = default; // 空令牌，永远不会被取消
+
+    bool isCancelled() const
+    {
+        return state_ != nullptr && state_->cancelled;
+    }
+
+private:
+    friend class CancellationSource;
+    template<typename R, typename F> friend class CancellableTask;
+
+    using Callbacks = std::list<std::function<void()>>;
+
+    struct State
+    {
+        std::atomic_bool cancelled{false};
+        std::mutex mtx;      // 只保护本组的回调链表，不涉及线程池的任务队列锁
+        Callbacks callbacks; // 本组还没开始执行的任务
+    };
+
+    explicit CancellationToken(std::shared_ptr<State> state)
+        : state_(std::move(state))
+    {}
+
+    // 登记取消回调，已经取消时返回false
+    bool registerCallback(std::function<void()> cb, Callbacks::iterator& handle)
+    {
+        if(state_ == nullptr)
+            return true;
+        std::lock_guard<std::mutex> lock(state_->mtx);
+        if(state_->cancelled)
+            return false;
+        handle = state_->callbacks.insert(state_->callbacks.end(), std::move(cb));
+        return true;
+    }
+
+    // 任务开始执行后注销回调，O(1)
+    void unregisterCallback(Callbacks::iterator handle)
+    {
+        if(state_ == nullptr)
+            return;
+        std::lock_guard<std::mutex> lock(state_->mtx);
+        // 已取消时链表已被cancel()取走，由它负责遍历
+        if(!state_->cancelled)
+            state_->callbacks.erase(handle);
+    }
+
+    std::shared_ptr<State> state_;
+};
+
+// 取消源：持有者调用cancel()取消它发出的所有令牌
+class CancellationSource
+{
+public:
+    CancellationSource()
+        : state_(std::make_shared<CancellationToken::State>())
+    {}
+
+    CancellationToken token() const
+    {
+        return CancellationToken(state_);
+    }
+
+    bool isCancelled() const
+    {
+        return state_->cancelled;
+    }
+
+    // 取消整组任务：只遍历本组登记的任务，代价与组大小成正比，和任务队列长度无关
+    void cancel()
+    {
+        CancellationToken::Callbacks callbacks;
+        {
+            std::lock_guard<std::mutex> lock(state_->mtx);
+            if(state_->cancelled)
+                return;
+            state_->cancelled = true;
+            callbacks.swap(state_->callbacks);
+        }
+        for(auto& cb : callbacks)
+        {
+            cb();
+        }
+    }
+
+private:
+    std::shared_ptr<CancellationToken::State> state_;
+};
+
+// 可取消的任务：执行和取消竞争同一个状态位，谁先拿到谁负责完成future
+template<typename R, typename F>
+class CancellableTask : public std::enable_shared_from_this<CancellableTask<R, F>>
+{
+public:
+    CancellableTask(F func, CancellationToken token)
+        : func_(std::move(func))
+        , token_(std::move(token))
+        , state_(PENDING)
+        , registered_(false)
+    {}
+
+    std::future<R> getFuture()
+    {
+        return promise_.get_future();
+    }
+
+    // 把任务登记到令牌上，令牌已取消时future直接变成取消状态
+    void attach()
+    {
+        std::weak_ptr<CancellableTask> weak = this->shared_from_this();
+        if(token_.registerCallback([weak]()
+            {
+                if(auto task = weak.lock())
+                    task->cancel();
+            }, handle_))
+        {
+            registered_ = true;
+        }
+        else
+        {
+            cancel();
+        }
+    }
+
+    bool isCancelled() const
+    {
+        return state_ == CANCELLED;
+    }
+
+    // 由工作线程调用，已被取消的任务直接跳过
+    void run()
+    {
+        int expected = PENDING;
+        if(!state_.compare_exchange_strong(expected, RUNNING))
+            return;
+        if(registered_)
+            token_.unregisterCallback(handle_);
+        try
+        {
+            if constexpr (std::is_void_v<R>)
+            {
+                func_();
+                promise_.set_value();
+            }
+            else
+            {
+                promise_.set_value(func_());
+            }
+        }
+        catch(...)
+        {
+            promise_.set_exception(std::current_exception());
+        }
+    }
+
+    // 入队失败时调用：注销登记的回调，以取消状态结束
+    void reject()
+    {
+        if(registered_)
+        {
+            registered_ = false;
+            token_.unregisterCallback(handle_);
+        }
+        cancel();
+    }
+
+    void cancel()
+    {
+        int expected = PENDING;
+        if(!state_.compare_exchange_strong(expected, CANCELLED))
+            return;
+        promise_.set_exception(std::make_exception_ptr(TaskCancelled()));
+    }
+
+private:
+    enum { PENDING, RUNNING, CANCELLED };
+
+    F func_;
+    CancellationToken token_;
+    std::promise<R> promise_;
+    std::atomic_int state_;
+    bool registered_;
+    CancellationToken::Callbacks::iterator handle_;
+};
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+
+#include "threadpool_2.h"
+
+// 多生产者多消费者通道，可有界也可无界，可关闭
+// 阻塞接口(send/recv)给普通线程用；线程池里的任务用异步接口(asyncSend/asyncRecv/consume/Select)，
+// 等待期间不占用工作线程，数据就绪后回调作为新任务提交到线程池
+// 线程池任务队列满、提交失败时回调在当前线程直接执行，已经交出的数据不会丢；回调抛出的异常只打印
+//
+//  Channel<Row> ch(64);
+//  pool.submitTask([&]{ for(...) ch.send(row); ch.close(); });
+//  ch.consume(pool, [](Row r){ ... }, []{ /* 通道关闭且读完 */ });
+template<typename T>
+class Channel
+{
+public:
+    // capacity为0表示无界
+    explicit Channel(size_t capacity = 0)
+        : capacity_(capacity)
+        , closed_(false)
+    {}
+    ~Channel() = default;
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // 阻塞发送，通道已关闭返回false
+    bool send(T value)
+    {
+        std::vector<std::function<void()>> post;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            notFull_.wait(lock, [&]()->bool{return closed_ || !full();});
+            if(closed_)
+                return false;
+            pushLocked(std::move(value), post);
+        }
+        runPost(post);
+        return true;
+    }
+
+    // 非阻塞发送，成功时value被移走
+    bool trySend(T& value)
+    {
+        std::vector<std::function<void()>> post;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(closed_ || full())
+                return false;
+            pushLocked(std::move(value), post);
+        }
+        runPost(post);
+        return true;
+    }
+
+    // 批量发送，一次加锁放入尽可能多的元素，返回发送成功的个数（通道关闭时可能不足）
+    size_t sendBatch(std::vector<T>&& items)
+    {
+        size_t sent = 0;
+        while(sent < items.size())
+        {
+            std::vector<std::function<void()>> post;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                notFull_.wait(lock, [&]()->bool{return closed_ || !full();});
+                if(closed_)
+                    break;
+                while(sent < items.size() && !full())
+                {
+                    pushLocked(std::move(items[sent++]), post);
+                }
+            }
+            runPost(post);
+        }
+        return sent;
+    }
+
+    // 阻塞接收，通道关闭且已读空时返回false
+    bool recv(T& out)
+    {
+        std::vector<std::function<void()>> post;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            notEmpty_.wait(lock, [&]()->bool{return closed_ || !buffer_.empty();});
+            std::optional<T> item = popLocked(post);
+            if(!item)
+                return false;
+            out = std::move(*item);
+        }
+        runPost(post);
+        return true;
+    }
+
+    // 非阻塞接收
+    bool tryRecv(T& out)
+    {
+        std::vector<std::function<void()>> post;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            std::optional<T> item = popLocked(post);
+            if(!item)
+                return false;
+            out = std::move(*item);
+        }
+        runPost(post);
+        return true;
+    }
+
+    // 批量接收，阻塞到至少有一个元素，最多取maxCount个追加到out，返回取到的个数
+    size_t recvBatch(std::vector<T>& out, size_t maxCount)
+    {
+        size_t count = 0;
+        std::vector<std::function<void()>> post;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            notEmpty_.wait(lock, [&]()->bool{return closed_ || !buffer_.empty();});
+            while(count < maxCount)
+            {
+                std::optional<T> item = popLocked(post);
+                if(!item)
+                    break;
+                out.push_back(std::move(*item));
+                count++;
+            }
+        }
+        runPost(post);
+        return count;
+    }
+
+    // 异步接收：有数据时回调在线程池上执行，参数为std::nullopt表示通道已关闭且读空
+    void asyncRecv(ThreadPool& pool, std::function<void(std::optional<T>)> cb)
+    {
+        addRecvWaiter(std::make_shared<RecvWaiter>(pool, std::move(cb), nullptr));
+    }
+
+    // 异步发送：通道满时不阻塞，放入通道后回调cb(true)，通道关闭则cb(false)
+    void asyncSend(ThreadPool& pool, T value, std::function<void(bool)> cb = nullptr)
+    {
+        std::vector<std::function<void()>> post;
+        bool ok = true;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(closed_)
+                ok = false;
+            else if(!full())
+                pushLocked(std::move(value), post);
+            else
+            {
+                sendWaiters_.push_back(SendWaiter{&pool, std::move(value), std::move(cb)});
+                return;
+            }
+        }
+        runPost(post);
+        if(cb)
+            postTo(pool, [cb, ok](){ cb(ok); });
+    }
+
+    // 持续异步消费直到通道关闭，每个元素在线程池上执行一次fn，最后执行done
+    // 通道对象需要活到done被调用
+    void consume(ThreadPool& pool, std::function<void(T)> fn, std::function<void()> done = nullptr)
+    {
+        asyncRecv(pool, [this, &pool, fn, done](std::optional<T> item)
+        {
+            if(!item)
+            {
+                if(done)
+                    done();
+                return;
+            }
+            fn(std::move(*item));
+            consume(pool, fn, done);
+        });
+    }
+
+    // 关闭通道：不能再发送，已有数据仍可读完；等待中的发送方失败，等待中的接收方收到std::nullopt
+    void close()
+    {
+        std::vector<std::function<void()>> post;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(closed_)
+                return;
+            closed_ = true;
+            for(auto& w : sendWaiters_)
+            {
+                if(w.cb)
+                    post.push_back(bindCallback(*w.pool, w.cb, false));
+            }
+            sendWaiters_.clear();
+            // 有接收方在等说明缓冲区为空
+            for(auto& w : recvWaiters_)
+            {
+                if(w->tryClaim())
+                    post.push_back(deliver(w, std::nullopt));
+            }
+            recvWaiters_.clear();
+        }
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+        runPost(post);
+    }
+
+    bool isClosed() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return closed_;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return buffer_.size();
+    }
+
+private:
+    friend class Select;
+
+    // 异步接收方；Select的多个分支共享同一个claim，只有先抢到的分支会被执行
+    struct RecvWaiter
+    {
+        RecvWaiter(ThreadPool& p, std::function<void(std::optional<T>)> c, std::shared_ptr<std::atomic_bool> cl)
+            : pool(&p), cb(std::move(c)), claim(std::move(cl))
+        {}
+
+        bool tryClaim()
+        {
+            return claim == nullptr || !claim->exchange(true);
+        }
+
+        bool claimed() const
+        {
+            return claim != nullptr && *claim;
+        }
+
+        ThreadPool* pool;
+        std::function<void(std::optional<T>)> cb;
+        std::shared_ptr<std::atomic_bool> claim;
+    };
+    using RecvWaiterPtr = std::shared_ptr<RecvWaiter>;
+
+    // 通道满时挂起的异步发送方
+    struct SendWaiter
+    {
+        ThreadPool* pool;
+        T value;
+        std::function<void(bool)> cb;
+    };
+
+    bool full() const
+    {
+        return capacity_ > 0 && buffer_.size() >= capacity_;
+    }
+
+    // 登记异步接收方，能立即满足时直接投递
+    void addRecvWaiter(RecvWaiterPtr w)
+    {
+        std::vector<std::function<void()>> post;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(!buffer_.empty() || closed_)
+            {
+                if(w->tryClaim())
+                    post.push_back(deliver(w, popLocked(post)));
+            }
+            else if(!w->claimed())
+            {
+                // 顺便清理已被其他Select分支抢走的等待者
+                for(auto it = recvWaiters_.begin(); it != recvWaiters_.end();)
+                {
+                    if((*it)->claimed())
+                        it = recvWaiters_.erase(it);
+                    else
+                        ++it;
+                }
+                recvWaiters_.push_back(std::move(w));
+            }
+        }
+        runPost(post);
+    }
+
+    // 放入一个元素：有异步接收方在等就直接交给它，否则进缓冲区。调用者持有锁且保证未满
+    void pushLocked(T&& value, std::vector<std::function<void()>>& post)
+    {
+        while(!recvWaiters_.empty())
+        {
+            RecvWaiterPtr w = std::move(recvWaiters_.front());
+            recvWaiters_.pop_front();
+            if(w->tryClaim())
+            {
+                post.push_back(deliver(w, std::move(value)));
+                return;
+            }
+        }
+        buffer_.push_back(std::move(value));
+        notEmpty_.notify_one();
+    }
+
+    // 取出一个元素，并把一个挂起的异步发送方的数据补进缓冲区。调用者持有锁，缓冲区为空时返回std::nullopt
+    std::optional<T> popLocked(std::vector<std::function<void()>>& post)
+    {
+        if(buffer_.empty())
+            return std::nullopt;
+        std::optional<T> out(std::move(buffer_.front()));
+        buffer_.pop_front();
+
+        if(!sendWaiters_.empty())
+        {
+            SendWaiter w = std::move(sendWaiters_.front());
+            sendWaiters_.pop_front();
+            buffer_.push_back(std::move(w.value));
+            if(w.cb)
+                post.push_back(bindCallback(*w.pool, w.cb, true));
+        }
+        else
+        {
+            notFull_.notify_one();
+        }
+        return out;
+    }
+
+    // 生成把接收回调提交到线程池的动作，在释放通道锁之后执行
+    static std::function<void()> deliver(const RecvWaiterPtr& w, std::optional<T> item)
+    {
+        // 用shared_ptr包一层，只能移动的T也能放进std::function
+        auto box = std::make_shared<std::optional<T>>(std::move(item));
+        ThreadPool* pool = w->pool;
+        auto cb = w->cb;
+        return [pool, cb, box]()
+        {
+            postTo(*pool, [cb, box](){ cb(std::move(*box)); });
+        };
+    }
+
+    static std::function<void()> bindCallback(ThreadPool& pool, std::function<void(bool)> cb, bool ok)
+    {
+        ThreadPool* p = &pool;
+        return [p, cb, ok]()
+        {
+            postTo(*p, [cb, ok](){ cb(ok); });
+        };
+    }
+
+    // 把回调提交到线程池，被拒绝时在当前线程直接执行；回调抛出的异常不会传给收发方
+    static void postTo(ThreadPool& pool, std::function<void()> fn)
+    {
+        pool.submitOrRun(std::move(fn));
+    }
+
+    static void runPost(std::vector<std::function<void()>>& post)
+    {
+        for(auto& f : post)
+        {
+            f();
+        }
+    }
+
+private:
+    size_t capacity_;
+    bool closed_;
+    std::deque<T> buffer_;
+    std::deque<RecvWaiterPtr> recvWaiters_;
+    std::deque<SendWaiter> sendWaiters_;
+
+    mutable std::mutex mtx_;
+    std::condition_variable notFull_;  // 阻塞发送方等待
+    std::condition_variable notEmpty_; // 阻塞接收方等待
+};
+
+// 同时等待多个通道，第一个就绪的分支在线程池上执行，其余分支作废
+//
+//  Select().onRecv<int>(a, [](std::optional<int> v){ ... })
+//          .onRecv<std::string>(b, [](std::optional<std::string> s){ ... })
+//          .run(pool);
+class Select
+{
+public:
+    Select()
+        : claim_(std::make_shared<std::atomic_bool>(false))
+    {}
+
+    template<typename T>
+    Select& onRecv(Channel<T>& ch, std::function<void(std::optional<T>)> cb)
+    {
+        auto claim = claim_;
+        arms_.push_back([&ch, cb, claim](ThreadPool& pool)
+        {
+            ch.addRecvWaiter(std::make_shared<typename Channel<T>::RecvWaiter>(pool, cb, claim));
+        });
+        return *this;
+    }
+
+    // 依次在各通道上登记，某个分支抢到后后面的分支不再登记
+    void run(ThreadPool& pool)
+    {
+        for(auto& arm : arms_)
+        {
+            if(*claim_)
+                break;
+            arm(pool);
+        }
+    }
+
+private:
+    std::shared_ptr<std::atomic_bool> claim_;
+    std::vector<std::function<void(ThreadPool&)>> arms_;
+};
+
+#endif
@@ -0,0 +1,443 @@
+#include "ioexecutor.h"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+const int IO_FLUSH_INTERVAL_MS = 1; // 收割线程提交未满一批请求的间隔
+
+// 一个IO请求
+struct IoExecutor::Op
+{
+    int opcode;
+    int fd;
+    void* buf;
+    size_t len;
+    off_t offset;
+    std::promise<ssize_t> promise;
+    std::function<void(ssize_t)> cb; // 不为空时用续接，不设置promise
+};
+
+// io_uring的共享内存映射
+struct IoExecutor::Ring
+{
+    int fd = -1;
+    bool extArg = false; // 内核支持带超时的等待
+
+    void* sqPtr = nullptr;
+    size_t sqSize = 0;
+    void* cqPtr = nullptr;
+    size_t cqSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqEntries = 0;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cqEntries = 0;
+};
+
+static int ioUringSetup(unsigned entries, io_uring_params* p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+// 离开作用域时减少在途计数，续接抛出异常时也会执行
+struct InflightGuard
+{
+    std::atomic_int& count;
+    ~InflightGuard()
+    {
+        count--;
+    }
+};
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+IoExecutor::IoExecutor(ThreadPool& pool, unsigned entries, bool useUring)
+    : pool_(pool)
+    , batchSize_(1)
+    , pending_(0)
+    , submitted_(0)
+    , maxInflight_(0)
+    , stop_(false)
+    , fallbackInflight_(0)
+{
+    if(useUring && setupRing(entries))
+    {
+        reaper_ = std::thread(&IoExecutor::reapCompletions, this);
+    }
+}
+
+IoExecutor::~IoExecutor()
+{
+    if(ring_ != nullptr)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            stop_ = true;
+            cond_.notify_all();
+        }
+        reaper_.join();
+        destroyRing();
+    }
+    while(fallbackInflight_ > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool IoExecutor::usingUring() const
+{
+    return ring_ != nullptr;
+}
+
+void IoExecutor::setBatchSize(unsigned n)
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    batchSize_ = n > 0 ? n : 1;
+}
+
+void IoExecutor::flush()
+{
+    if(ring_ == nullptr)
+        return;
+    std::vector<Completion> failed;
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        enterLocked(failed);
+    }
+    completeAll(failed);
+}
+
+bool IoExecutor::setupRing(unsigned entries)
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = ioUringSetup(entries, &p);
+    if(fd < 0)
+    {
+        std::cerr << "io_uring unavailable (" << strerror(errno) << "), fall back to thread pool." << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<Ring> r = std::make_unique<Ring>();
+    r->fd = fd;
+    r->extArg = (p.features & IORING_FEAT_EXT_ARG) != 0;
+    r->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single)
+    {
+        r->sqSize = r->cqSize = std::max(r->sqSize, r->cqSize);
+    }
+
+    r->sqPtr = mmap(nullptr, r->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(r->sqPtr == MAP_FAILED)
+    {
+        r->sqPtr = nullptr;
+        ring_ = std::move(r);
+        destroyRing();
+        return false;
+    }
+    if(single)
+    {
+        r->cqPtr = r->sqPtr;
+    }
+    else
+    {
+        r->cqPtr = mmap(nullptr, r->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(r->cqPtr == MAP_FAILED)
+        {
+            r->cqPtr = nullptr;
+            ring_ = std::move(r);
+            destroyRing();
+            return false;
+        }
+    }
+    r->sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        ring_ = std::move(r);
+        destroyRing();
+        return false;
+    }
+    r->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(r->sqPtr);
+    r->sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    r->sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    r->sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    r->sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    r->sqEntries = p.sq_entries;
+
+    char* cq = static_cast<char*>(r->cqPtr);
+    r->cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    r->cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    r->cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    r->cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    r->cqEntries = p.cq_entries;
+
+    maxInflight_ = p.cq_entries;
+    ring_ = std::move(r);
+    return true;
+}
+
+void IoExecutor::destroyRing()
+{
+    Ring* r = ring_.get();
+    if(r->sqes != nullptr)
+        munmap(r->sqes, r->sqesSize);
+    if(r->cqPtr != nullptr && r->cqPtr != r->sqPtr)
+        munmap(r->cqPtr, r->cqSize);
+    if(r->sqPtr != nullptr)
+        munmap(r->sqPtr, r->sqSize);
+    close(r->fd);
+    ring_.reset();
+}
+
+std::future<ssize_t> IoExecutor::asyncRead(int fd, void* buf, size_t len, off_t offset)
+{
+    return submitFuture(new Op{IORING_OP_READ, fd, buf, len, offset, {}, nullptr});
+}
+
+std::future<ssize_t> IoExecutor::asyncWrite(int fd, const void* buf, size_t len, off_t offset)
+{
+    return submitFuture(new Op{IORING_OP_WRITE, fd, const_cast<void*>(buf), len, offset, {}, nullptr});
+}
+
+std::future<ssize_t> IoExecutor::asyncFsync(int fd)
+{
+    return submitFuture(new Op{IORING_OP_FSYNC, fd, nullptr, 0, 0, {}, nullptr});
+}
+
+void IoExecutor::asyncRead(int fd, void* buf, size_t len, off_t offset, std::function<void(ssize_t)> cb)
+{
+    submitOp(new Op{IORING_OP_READ, fd, buf, len, offset, {}, std::move(cb)});
+}
+
+void IoExecutor::asyncWrite(int fd, const void* buf, size_t len, off_t offset, std::function<void(ssize_t)> cb)
+{
+    submitOp(new Op{IORING_OP_WRITE, fd, const_cast<void*>(buf), len, offset, {}, std::move(cb)});
+}
+
+void IoExecutor::asyncFsync(int fd, std::function<void(ssize_t)> cb)
+{
+    submitOp(new Op{IORING_OP_FSYNC, fd, nullptr, 0, 0, {}, std::move(cb)});
+}
+
+std::future<ssize_t> IoExecutor::submitFuture(Op* op)
+{
+    std::future<ssize_t> result = op->promise.get_future();
+    submitOp(op);
+    return result;
+}
+
+void IoExecutor::submitOp(Op* op)
+{
+    if(ring_ == nullptr)
+    {
+        // 退化方案：在线程池上执行阻塞调用
+        fallbackInflight_++;
+        // 续接抛出的异常由线程池捕获打印
+        pool_.submitOrRun([this, op]()
+        {
+            InflightGuard guard{fallbackInflight_};
+            ssize_t res;
+            if(op->opcode == IORING_OP_READ)
+                res = pread(op->fd, op->buf, op->len, op->offset);
+            else if(op->opcode == IORING_OP_WRITE)
+                res = pwrite(op->fd, op->buf, op->len, op->offset);
+            else
+                res = fsync(op->fd);
+            complete(op, res < 0 ? -errno : res, true);
+        });
+        return;
+    }
+
+    std::vector<Completion> failed;
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        // 在途请求不超过完成队列大小，超出时提交方等待
+        cond_.wait(lock, [&]()->bool{return pending_ + submitted_ < maxInflight_;});
+        // 提交失败时enterLocked会清空提交队列，之后一定能写入
+        while(!pushSqeLocked(op))
+        {
+            enterLocked(failed);
+        }
+        if(pending_ >= batchSize_)
+        {
+            enterLocked(failed);
+        }
+        cond_.notify_all();
+    }
+    completeAll(failed);
+}
+
+// 写入一个提交队列项，队列满时返回false
+bool IoExecutor::pushSqeLocked(Op* op)
+{
+    Ring* r = ring_.get();
+    unsigned tail = *r->sqTail;
+    unsigned head = __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE);
+    if(tail - head >= r->sqEntries)
+        return false;
+
+    unsigned idx = tail & *r->sqMask;
+    io_uring_sqe* sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)op->opcode;
+    sqe->fd = op->fd;
+    sqe->addr = (uint64_t)(uintptr_t)op->buf;
+    sqe->len = (uint32_t)std::min(op->len, IO_MAX_RW_COUNT); // 超出部分由调用方按返回的长度继续
+    sqe->off = (uint64_t)op->offset;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    r->sqArray[idx] = idx;
+    __atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+    pending_++;
+    return true;
+}
+
+// 把攒下的请求一次提交给内核；无法重试的错误时撤回内核没有取走的请求，放入failed以-errno结束
+void IoExecutor::enterLocked(std::vector<Completion>& failed)
+{
+    while(pending_ > 0)
+    {
+        int ret = ioUringEnter(ring_->fd, pending_, 0, 0, nullptr, 0);
+        if(ret < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            int err = errno;
+            std::cerr << "io_uring_enter fail: " << strerror(err) << std::endl;
+            Ring* r = ring_.get();
+            unsigned head = __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE);
+            unsigned tail = *r->sqTail;
+            for(unsigned i = head; i != tail; i++)
+            {
+                io_uring_sqe* sqe = &r->sqes[i & *r->sqMask];
+                failed.emplace_back(reinterpret_cast<Op*>((uintptr_t)sqe->user_data), -err);
+            }
+            __atomic_store_n(r->sqTail, head, __ATOMIC_RELEASE);
+            pending_ = 0;
+            cond_.notify_all();
+            return;
+        }
+        pending_ -= ret;
+        submitted_ += ret;
+    }
+}
+
+void IoExecutor::complete(Op* op, ssize_t res, bool onWorker)
+{
+    std::unique_ptr<Op> guard(op); // 续接抛出异常时也要释放
+    if(op->cb)
+    {
+        if(onWorker)
+            op->cb(res);
+        else
+        {
+            // 收割线程上不能执行用户代码，异常由线程池捕获打印
+            std::function<void(ssize_t)> cb = std::move(op->cb);
+            pool_.submitOrRun([cb, res](){ cb(res); });
+        }
+    }
+    else
+    {
+        op->promise.set_value(res);
+    }
+}
+
+void IoExecutor::completeAll(std::vector<Completion>& done)
+{
+    for(auto& d : done)
+    {
+        complete(d.first, d.second, false);
+    }
+    done.clear();
+}
+
+// 收割线程：提交未满一批的请求，阻塞等待完成事件并分发
+void IoExecutor::reapCompletions()
+{
+    Ring* r = ring_.get();
+    std::vector<Completion> done;
+    for(;;)
+    {
+        bool idle;
+        bool exiting;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if(submitted_ == 0)
+            {
+                cond_.wait_for(lock, std::chrono::milliseconds(IO_FLUSH_INTERVAL_MS),
+                    [&]()->bool{return stop_ || pending_ > 0;});
+            }
+            enterLocked(done);
+            idle = submitted_ == 0;
+            exiting = idle && stop_ && pending_ == 0;
+        }
+        completeAll(done); // 提交失败的请求
+        if(exiting)
+            return;
+        if(idle)
+            continue;
+
+        // 等至少一个完成事件；支持超时的内核上最多等IO_FLUSH_INTERVAL_MS，以便提交新攒下的请求
+        if(r->extArg)
+        {
+            __kernel_timespec ts;
+            ts.tv_sec = 0;
+            ts.tv_nsec = IO_FLUSH_INTERVAL_MS * 1000000LL;
+            io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            ioUringEnter(r->fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        }
+        else
+        {
+            ioUringEnter(r->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, _NSIG / 8);
+        }
+
+        done.clear();
+        unsigned head = *r->cqHead;
+        unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+        while(head != tail)
+        {
+            io_uring_cqe* cqe = &r->cqes[head & *r->cqMask];
+            done.emplace_back(reinterpret_cast<Op*>((uintptr_t)cqe->user_data), cqe->res);
+            head++;
+        }
+        __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+        if(done.empty())
+            continue;
+
+        // Op是提交方在锁内写入提交队列的，先加一次锁再访问，和提交方建立先后关系
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            submitted_ -= done.size();
+            cond_.notify_all();
+        }
+        completeAll(done);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef IOEXECUTOR_H
+#define IOEXECUTOR_H
+
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <sys/types.h>
+
+#include "threadpool_2.h"
+
+// 与线程池配合的异步文件IO
+// 内核支持io_uring时，请求写入提交队列后批量提交，由单独的收割线程取完成事件，
+// 工作线程不会阻塞在IO上，固定大小的线程池也能同时挂着成千上万个IO；
+// 不支持时退化为在线程池上执行阻塞的pread/pwrite/fsync。
+// 结果为读写的字节数，失败时为-errno。和pread/pwrite一样可能只读写了一部分，
+// 单次最多IO_MAX_RW_COUNT字节，更大的请求返回部分长度，由调用方继续。
+const size_t IO_MAX_RW_COUNT = 0x7ffff000; // 和Linux单次read/write的上限一致
+
+class IoExecutor
+{
+public:
+    // entries为提交队列大小，useUring为false时强制使用线程池
+    IoExecutor(ThreadPool& pool, unsigned entries = 256, bool useUring = true);
+    // 等待所有在途请求完成
+    ~IoExecutor();
+
+    IoExecutor(const IoExecutor&) = delete;
+    IoExecutor& operator=(const IoExecutor&) = delete;
+
+    // 是否使用io_uring
+    bool usingUring() const;
+
+    // 攒够n个请求才提交一次系统调用，默认1即立即提交；未满一批的请求最迟约1ms后由收割线程提交
+    void setBatchSize(unsigned n);
+
+    // 立即提交已攒下的请求
+    void flush();
+
+    std::future<ssize_t> asyncRead(int fd, void* buf, size_t len, off_t offset);
+    std::future<ssize_t> asyncWrite(int fd, const void* buf, size_t len, off_t offset);
+    std::future<ssize_t> asyncFsync(int fd);
+
+    // 续接版本：完成后cb(结果)作为任务在线程池上执行，线程池拒绝时在收割线程上执行；cb抛出的异常只打印
+    void asyncRead(int fd, void* buf, size_t len, off_t offset, std::function<void(ssize_t)> cb);
+    void asyncWrite(int fd, const void* buf, size_t len, off_t offset, std::function<void(ssize_t)> cb);
+    void asyncFsync(int fd, std::function<void(ssize_t)> cb);
+
+private:
+    struct Op;
+    struct Ring;
+    using Completion = std::pair<Op*, ssize_t>;
+
+    std::future<ssize_t> submitFuture(Op* op);
+    void submitOp(Op* op);
+    void complete(Op* op, ssize_t res, bool onWorker);
+    void completeAll(std::vector<Completion>& done);
+    bool setupRing(unsigned entries);
+    void destroyRing();
+    bool pushSqeLocked(Op* op);
+    void enterLocked(std::vector<Completion>& failed);
+    void reapCompletions();
+
+    ThreadPool& pool_;
+    std::unique_ptr<Ring> ring_;     // 为空表示使用线程池退化方案
+    unsigned batchSize_;
+    unsigned pending_;               // 已写入提交队列但还没提交给内核的请求
+    unsigned submitted_;             // 已提交给内核还没完成的请求
+    unsigned maxInflight_;           // 在途请求上限，不超过完成队列大小
+
+    std::mutex mtx_;                 // 保护提交队列和上面的计数
+    std::condition_variable cond_;   // 收割线程等待请求 / 提交方等待在途请求减少
+    bool stop_;
+    std::thread reaper_;
+    std::atomic_int fallbackInflight_; // 退化方案下在途的请求数
+};
+
+#endif
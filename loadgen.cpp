@@ -0,0 +1,445 @@
+// 开环压测工具：按目标到达率（泊松/突发）向ThreadPool提交任务，
+// 统计 提交->开始 与 提交->完成 的延迟分布，扫描到达率寻找拐点
+//
+// 编译: g++ -std=c++17 -O2 -pthread loadgen.cpp threadpool_2.cpp -o loadgen
+// 示例: ./loadgen --mode fixed,cached --threads 4 --service-us 200
+//                 --rate-min 1000 --rate-max 30000 --steps 8 --format csv --out curve.csv
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "threadpool_2.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+// 压测参数
+struct Options
+{
+    std::vector<PoolMode> modes{PoolMode::MODE_FIXED};
+    int threads = 4;
+    size_t stackKb = 0;                // 工作线程栈大小，0为系统默认
+    size_t guardKb = 0;                // 工作线程栈保护区大小，0为系统默认
+    std::string arrival = "poisson";   // poisson | bursty
+    int burst = 16;                    // bursty模式下每次突发的任务数
+    std::string service = "exp";       // const | exp | lognormal
+    double serviceUs = 100;            // 平均服务时间（微秒）
+    std::string work = "spin";         // spin：占用CPU  sleep：模拟阻塞
+    double rateMin = 1000;             // 每秒任务数
+    double rateMax = 20000;
+    int steps = 6;
+    double duration = 2.0;             // 每个到达率持续的秒数
+    double kneeFactor = 10.0;          // p99超过基线多少倍视为拐点
+    std::string format = "csv";        // csv | json
+    std::string out;                   // 为空时输出到stdout
+};
+
+// 单个任务的时间戳（相对本轮起点的纳秒数）
+struct Sample
+{
+    int64_t intended = 0; // 计划到达时间，延迟从这里算起以修正coordinated omission
+    int64_t start = -1;
+    int64_t end = -1;
+};
+
+// 一轮压测共享的状态，用shared_ptr持有，超时放弃后迟到的任务也不会访问已释放内存
+struct Round
+{
+    Clock::time_point base;
+    std::vector<Sample> samples;
+    std::atomic_int done{0};
+    std::atomic_bool abort{false};
+};
+
+// 单个到达率下的统计结果
+struct StepResult
+{
+    std::string mode;
+    double offered = 0;
+    double achieved = 0;
+    int submitted = 0;
+    int completed = 0;
+    int timedOut = 0;
+    int64_t genLagMaxNs = 0;
+    std::vector<int64_t> queuePct;    // 提交->开始
+    std::vector<int64_t> completePct; // 提交->完成
+    long threads = 0;
+    long vmRssKb = 0;
+    long vmSizeKb = 0;
+    double spawnUs = 0;       // 启动初始线程时平均每个线程的创建耗时
+    long workerVmKb = 0;      // 启动初始线程时平均每个线程增加的虚拟内存
+    bool knee = false;
+};
+
+const double PERCENTILES[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+const char* PERCENTILE_NAMES[] = {"p50", "p90", "p99", "p999", "max"};
+const int PERCENTILE_COUNT = 5;
+
+const char* modeName(PoolMode mode)
+{
+    return mode == PoolMode::MODE_CACHED ? "cached" : "fixed";
+}
+
+int64_t nowNs(const Clock::time_point& base)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - base).count();
+}
+
+// 读取/proc/self/status中的一项（单位与文件一致）
+long readProcStatus(const std::string& key)
+{
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':')
+        {
+            return std::strtol(line.c_str() + key.size() + 1, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+// 按计划时间等待：远的时候sleep，近的时候自旋，降低生成器自身的抖动
+void waitUntil(const Clock::time_point& t)
+{
+    for(;;)
+    {
+        auto left = t - Clock::now();
+        if(left <= std::chrono::nanoseconds(0))
+            return;
+        if(left > std::chrono::microseconds(200))
+            std::this_thread::sleep_for(left - std::chrono::microseconds(100));
+        else
+            std::this_thread::yield();
+    }
+}
+
+// 模拟任务执行
+void serve(int64_t ns, bool spin)
+{
+    if(!spin)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+        return;
+    }
+    auto end = Clock::now() + std::chrono::nanoseconds(ns);
+    while(Clock::now() < end)
+    {
+    }
+}
+
+std::vector<int64_t> percentiles(std::vector<int64_t>& v)
+{
+    std::vector<int64_t> res(PERCENTILE_COUNT, 0);
+    if(v.empty())
+        return res;
+    std::sort(v.begin(), v.end());
+    for(int i = 0; i < PERCENTILE_COUNT; i++)
+    {
+        size_t idx = (size_t)std::ceil(PERCENTILES[i] * v.size());
+        res[i] = v[idx == 0 ? 0 : idx - 1];
+    }
+    return res;
+}
+
+// 以给定到达率对线程池做一轮开环压测
+StepResult runStep(ThreadPool& pool, const Options& opt, PoolMode mode, double rate, std::mt19937_64& rng)
+{
+    auto round = std::make_shared<Round>();
+    int total = std::max(1, (int)(rate * opt.duration));
+    round->samples.resize(total);
+
+    // 预先生成到达时间与服务时间，避免生成器在提交路径上做额外计算
+    std::exponential_distribution<double> gap(opt.arrival == "bursty" ? rate / opt.burst : rate);
+    std::vector<int64_t> service(total);
+    {
+        double mean = opt.serviceUs * 1000.0;
+        std::exponential_distribution<double> expDist(1.0 / mean);
+        const double sigma = 1.0;
+        std::lognormal_distribution<double> logDist(std::log(mean) - sigma * sigma / 2, sigma);
+        for(int i = 0; i < total; i++)
+        {
+            if(opt.service == "const")
+                service[i] = (int64_t)mean;
+            else if(opt.service == "lognormal")
+                service[i] = (int64_t)logDist(rng);
+            else
+                service[i] = (int64_t)expDist(rng);
+        }
+    }
+    double t = 0;
+    for(int i = 0; i < total; i++)
+    {
+        // bursty：突发之间按指数间隔，突发内部的任务同时到达
+        if(opt.arrival != "bursty" || i % opt.burst == 0)
+            t += gap(rng);
+        round->samples[i].intended = (int64_t)(t * 1e9);
+    }
+
+    bool spin = opt.work == "spin";
+    StepResult res;
+    res.mode = modeName(mode);
+    res.offered = rate;
+    round->base = Clock::now() + std::chrono::milliseconds(1);
+
+    for(int i = 0; i < total; i++)
+    {
+        Sample* s = &round->samples[i];
+        waitUntil(round->base + std::chrono::nanoseconds(s->intended));
+        res.genLagMaxNs = std::max(res.genLagMaxNs, nowNs(round->base) - s->intended);
+
+        int64_t ns = service[i];
+        pool.submitTask([round, s, ns, spin]()
+        {
+            s->start = nowNs(round->base);
+            if(!round->abort)
+                serve(ns, spin);
+            s->end = nowNs(round->base);
+            round->done++;
+        });
+        res.submitted++;
+    }
+
+    // 等待队列排空；过载时不无限等下去，超时后剩余任务跳过执行只打时间戳
+    auto deadline = Clock::now() + std::chrono::duration<double>(std::max(5.0, opt.duration * 2));
+    while(round->done < total && Clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    int64_t abortNs = nowNs(round->base);
+    int doneAtDeadline = round->done;
+    round->abort = true;
+    while(round->done < total)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::vector<int64_t> queueLat, completeLat;
+    queueLat.reserve(total);
+    completeLat.reserve(total);
+    int64_t lastEnd = 0;
+    for(const Sample& s : round->samples)
+    {
+        // 超时任务的延迟按放弃时刻计，只是下界，但不会被当作“快”的样本丢掉
+        bool late = s.end > abortNs || s.start > abortNs;
+        int64_t start = late ? std::min(s.start, abortNs) : s.start;
+        int64_t end = late ? abortNs : s.end;
+        queueLat.push_back(start - s.intended);
+        completeLat.push_back(end - s.intended);
+        if(!late)
+            lastEnd = std::max(lastEnd, s.end);
+    }
+    res.completed = doneAtDeadline;
+    res.timedOut = total - doneAtDeadline;
+    res.achieved = lastEnd > 0 ? res.completed / (lastEnd / 1e9) : 0;
+    res.queuePct = percentiles(queueLat);
+    res.completePct = percentiles(completeLat);
+    res.threads = readProcStatus("Threads");
+    res.vmRssKb = readProcStatus("VmRSS");
+    res.vmSizeKb = readProcStatus("VmSize");
+    return res;
+}
+
+// 拐点：吞吐跟不上到达率，或者p99相对最低负载恶化kneeFactor倍
+void markKnee(std::vector<StepResult>& results, size_t from, double kneeFactor)
+{
+    if(from >= results.size())
+        return;
+    int64_t baseP99 = std::max<int64_t>(1, results[from].completePct[2]);
+    for(size_t i = from; i < results.size(); i++)
+    {
+        const StepResult& r = results[i];
+        if(r.timedOut > 0 || r.achieved < 0.9 * r.offered || r.completePct[2] > kneeFactor * baseP99)
+        {
+            results[i].knee = true;
+            return;
+        }
+    }
+}
+
+void writeCsv(std::ostream& out, const std::vector<StepResult>& results)
+{
+    out << "mode,offered_rps,achieved_rps,submitted,completed,timed_out,gen_lag_max_us";
+    for(int i = 0; i < PERCENTILE_COUNT; i++)
+        out << ",queue_" << PERCENTILE_NAMES[i] << "_us";
+    for(int i = 0; i < PERCENTILE_COUNT; i++)
+        out << ",complete_" << PERCENTILE_NAMES[i] << "_us";
+    out << ",threads,vm_rss_kb,vm_size_kb,spawn_us,worker_vm_kb,knee\n";
+    for(const StepResult& r : results)
+    {
+        out << r.mode << ',' << r.offered << ',' << r.achieved << ',' << r.submitted << ','
+            << r.completed << ',' << r.timedOut << ',' << r.genLagMaxNs / 1000.0;
+        for(int64_t v : r.queuePct)
+            out << ',' << v / 1000.0;
+        for(int64_t v : r.completePct)
+            out << ',' << v / 1000.0;
+        out << ',' << r.threads << ',' << r.vmRssKb << ',' << r.vmSizeKb << ',' << r.spawnUs
+            << ',' << r.workerVmKb << ',' << (r.knee ? 1 : 0) << '\n';
+    }
+}
+
+void writeJson(std::ostream& out, const std::vector<StepResult>& results)
+{
+    auto pct = [&](const std::vector<int64_t>& v)
+    {
+        std::ostringstream os;
+        os << '{';
+        for(int i = 0; i < PERCENTILE_COUNT; i++)
+            os << (i ? ", " : "") << '"' << PERCENTILE_NAMES[i] << "\": " << v[i] / 1000.0;
+        os << '}';
+        return os.str();
+    };
+    out << "[\n";
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const StepResult& r = results[i];
+        out << "  {\"mode\": \"" << r.mode << "\", \"offered_rps\": " << r.offered
+            << ", \"achieved_rps\": " << r.achieved << ", \"submitted\": " << r.submitted
+            << ", \"completed\": " << r.completed << ", \"timed_out\": " << r.timedOut
+            << ", \"gen_lag_max_us\": " << r.genLagMaxNs / 1000.0
+            << ", \"queue_us\": " << pct(r.queuePct)
+            << ", \"complete_us\": " << pct(r.completePct)
+            << ", \"threads\": " << r.threads << ", \"vm_rss_kb\": " << r.vmRssKb
+            << ", \"vm_size_kb\": " << r.vmSizeKb << ", \"spawn_us\": " << r.spawnUs
+            << ", \"worker_vm_kb\": " << r.workerVmKb
+            << ", \"knee\": " << (r.knee ? "true" : "false") << '}'
+            << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "]\n";
+}
+
+void usage()
+{
+    std::cerr << "usage: loadgen [--mode fixed,cached] [--threads N] [--stack-kb KB] [--guard-kb KB]\n"
+              << "               [--arrival poisson|bursty] [--burst N]\n"
+              << "               [--service const|exp|lognormal] [--service-us US] [--work spin|sleep]\n"
+              << "               [--rate-min RPS] [--rate-max RPS] [--steps N] [--duration SEC]\n"
+              << "               [--knee-factor X] [--format csv|json] [--out FILE]" << std::endl;
+}
+
+bool parseArgs(int argc, char** argv, Options& opt)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(i + 1 >= argc)
+            return false;
+        std::string val = argv[++i];
+        if(arg == "--mode")
+        {
+            opt.modes.clear();
+            std::stringstream ss(val);
+            std::string m;
+            while(std::getline(ss, m, ','))
+            {
+                if(m == "fixed")
+                    opt.modes.push_back(PoolMode::MODE_FIXED);
+                else if(m == "cached")
+                    opt.modes.push_back(PoolMode::MODE_CACHED);
+                else
+                    return false;
+            }
+        }
+        else if(arg == "--threads") opt.threads = std::stoi(val);
+        else if(arg == "--stack-kb") opt.stackKb = std::stoul(val);
+        else if(arg == "--guard-kb") opt.guardKb = std::stoul(val);
+        else if(arg == "--arrival") opt.arrival = val;
+        else if(arg == "--burst") opt.burst = std::max(1, std::stoi(val));
+        else if(arg == "--service") opt.service = val;
+        else if(arg == "--service-us") opt.serviceUs = std::stod(val);
+        else if(arg == "--work") opt.work = val;
+        else if(arg == "--rate-min") opt.rateMin = std::stod(val);
+        else if(arg == "--rate-max") opt.rateMax = std::stod(val);
+        else if(arg == "--steps") opt.steps = std::max(1, std::stoi(val));
+        else if(arg == "--duration") opt.duration = std::stod(val);
+        else if(arg == "--knee-factor") opt.kneeFactor = std::stod(val);
+        else if(arg == "--format") opt.format = val;
+        else if(arg == "--out") opt.out = val;
+        else
+            return false;
+    }
+    return !opt.modes.empty() && opt.rateMin > 0 && opt.rateMax >= opt.rateMin;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if(!parseArgs(argc, argv, opt))
+    {
+        usage();
+        return 1;
+    }
+
+    // 线程池在取任务时会打印日志，压测时屏蔽掉，避免stdout的锁和IO混进延迟
+    std::streambuf* stdoutBuf = std::cout.rdbuf(nullptr);
+
+    std::mt19937_64 rng(12345);
+    std::vector<StepResult> results;
+    // 线程池在进程退出前都保持存活，各模式互不影响
+    std::vector<std::unique_ptr<ThreadPool>> pools;
+    for(PoolMode mode : opt.modes)
+    {
+        pools.push_back(std::make_unique<ThreadPool>());
+        ThreadPool& pool = *pools.back();
+        pool.setMode(mode);
+        pool.setThreadStackSize(opt.stackKb * 1024);
+        pool.setThreadGuardSize(opt.guardKb * 1024);
+
+        // 工作线程的创建耗时与内存占用
+        long vmBefore = readProcStatus("VmSize");
+        auto spawnBegin = Clock::now();
+        pool.start(opt.threads);
+        double spawnUs = std::chrono::duration<double, std::micro>(Clock::now() - spawnBegin).count() / std::max(1, opt.threads);
+        long workerVmKb = (readProcStatus("VmSize") - vmBefore) / std::max(1, opt.threads);
+        std::cerr << modeName(mode) << " spawn=" << spawnUs << "us/worker vm=" << workerVmKb << "KB/worker" << std::endl;
+
+        size_t from = results.size();
+        for(int i = 0; i < opt.steps; i++)
+        {
+            // 到达率按几何级数扫描，拐点附近的分辨率更均匀
+            double rate = opt.steps == 1 ? opt.rateMin
+                : opt.rateMin * std::pow(opt.rateMax / opt.rateMin, (double)i / (opt.steps - 1));
+            results.push_back(runStep(pool, opt, mode, rate, rng));
+            results.back().spawnUs = spawnUs;
+            results.back().workerVmKb = workerVmKb;
+            const StepResult& r = results.back();
+            std::cerr << modeName(mode) << " offered=" << r.offered << " achieved=" << r.achieved
+                      << " p99=" << r.completePct[2] / 1000.0 << "us timed_out=" << r.timedOut << std::endl;
+        }
+        markKnee(results, from, opt.kneeFactor);
+    }
+
+    std::ofstream file;
+    std::ostream stdoutStream(stdoutBuf);
+    std::ostream* out = &stdoutStream;
+    if(!opt.out.empty())
+    {
+        file.open(opt.out);
+        if(!file)
+        {
+            std::cerr << "open " << opt.out << " fail." << std::endl;
+            return 1;
+        }
+        out = &file;
+    }
+    if(opt.format == "json")
+        writeJson(*out, results);
+    else
+        writeCsv(*out, results);
+    out->flush();
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <future>
+
+#include "threadpool_2.h"
+
+// 亲和提交测试：同一个key在同一个线程执行、忙太久的线程的本地任务被取走、连续短任务积压时被分担、亲和提交后立即析构线程池
+// 编译: g++ -std=c++17 -pthread main_affinity.cpp threadpool_2.cpp -o main_affinity
+
+// 阈值很大时任务都由指定的线程执行，同一个key总在同一个线程上
+bool testLocalHits()
+{
+    ThreadPool pool;
+    pool.setAffinityStealThreshold(1000000);
+    pool.start(4);
+
+    std::mutex mtx;
+    std::map<uint64_t, std::set<std::thread::id>> seen;
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < 2000; i++)
+    {
+        uint64_t key = i % 8;
+        results.push_back(pool.submitTask(Affinity::key(key), [&mtx, &seen, key]()
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            seen[key].insert(std::this_thread::get_id());
+        }));
+        if(i % 3 == 0)
+            results.push_back(pool.submitTask([](){})); // 混入普通任务
+    }
+    for(auto& f : results)
+        f.get();
+
+    for(auto& kv : seen)
+    {
+        if(kv.second.size() != 1)
+            return false;
+    }
+    AffinityStats stats = pool.getAffinityStats();
+    std::future<int> sum = pool.submitTask(Affinity::worker(2), [](int a, int b){ return a + b; }, 1, 2);
+    return stats.submitted == 2000 && stats.localHits == 2000 && stats.stolen == 0 && stats.queued == 0
+        && sum.get() == 3;
+}
+
+// 所有任务都指定给0号线程，它忙的时候其他线程把积压的任务取走
+bool testSteal()
+{
+    ThreadPool pool;
+    pool.setAffinityStealThreshold(1000);
+    pool.start(4);
+
+    std::vector<std::future<int>> results;
+    for(int i = 0; i < 100; i++)
+    {
+        results.push_back(pool.submitTask(Affinity::worker(0), [i]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+            return i;
+        }));
+    }
+    for(int i = 0; i < 100; i++)
+    {
+        if(results[i].get() != i)
+            return false;
+    }
+    AffinityStats stats = pool.getAffinityStats();
+    std::cerr << "local hits " << stats.localHits << ", stolen " << stats.stolen << std::endl;
+    return stats.localHits + stats.stolen == 100 && stats.stolen > 0;
+}
+
+// 0号线程连续执行很多短任务，每个都不超过阈值，但积压的任务等待太久后仍被其他线程分担
+bool testStealShortTasks()
+{
+    ThreadPool pool;
+    pool.start(4);
+
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < 400; i++)
+    {
+        results.push_back(pool.submitTask(Affinity::worker(0), []()
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(1500));
+        }));
+    }
+    for(auto& f : results)
+        f.get();
+    AffinityStats stats = pool.getAffinityStats();
+    std::cerr << "short tasks: local hits " << stats.localHits << ", stolen " << stats.stolen << std::endl;
+    return stats.localHits + stats.stolen == 400 && stats.stolen >= 200;
+}
+
+// 亲和提交后立即析构线程池，所有任务执行完且析构不会卡住
+bool testDestroyAfterSubmit()
+{
+    std::atomic_int ran(0);
+    for(int round = 0; round < 500; round++)
+    {
+        ThreadPool pool;
+        pool.start(4);
+        for(int i = 0; i < 4; i++)
+        {
+            pool.submitTask(Affinity::worker(i), [&ran](){ ran++; });
+        }
+    }
+    // 启动前提交的任务进入默认租户的队列
+    {
+        ThreadPool pool;
+        pool.submitTask(Affinity::key(1), [&ran](){ ran++; });
+        pool.start(2);
+    }
+    return ran == 500 * 4 + 1;
+}
+
+int main()
+{
+    std::cout.rdbuf(nullptr); // 线程池每个任务都会打印，关掉
+
+    int failed = 0;
+    if(!testLocalHits())
+    {
+        std::cerr << "local hits fail" << std::endl;
+        failed++;
+    }
+    if(!testSteal())
+    {
+        std::cerr << "steal fail" << std::endl;
+        failed++;
+    }
+    if(!testStealShortTasks())
+    {
+        std::cerr << "steal short tasks fail" << std::endl;
+        failed++;
+    }
+    if(!testDestroyAfterSubmit())
+    {
+        std::cerr << "destroy after submit fail" << std::endl;
+        failed++;
+    }
+
+    std::cerr << (failed == 0 ? "affinity ok" : "affinity fail") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <future>
+
+#include "threadpool_2.h"
+
+// 取消测试：cancel()之后排队的任务不再执行且future以TaskCancelled结束、已取消的令牌提交、队列满被拒绝、执行中的任务轮询
+// 编译: g++ -std=c++17 -pthread main_cancel.cpp threadpool_2.cpp -o main_cancel
+
+// future是否以TaskCancelled结束
+template<typename T>
+bool isCancelledFuture(std::future<T>& f)
+{
+    try
+    {
+        f.get();
+    }
+    catch(const TaskCancelled&)
+    {
+        return true;
+    }
+    return false;
+}
+
+// 单线程被一个任务挡住，后面排队的任务在cancel()之后都不执行
+bool testQueued(ThreadPool& pool)
+{
+    CancellationSource source;
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::future<void> blocker = pool.submitTask([opened](){ opened.wait(); });
+
+    std::atomic_int ran(0);
+    std::vector<std::future<int>> results;
+    for(int i = 0; i < 300; i++)
+    {
+        results.push_back(pool.submitTask(source.token(), [&ran](int v){ ran++; return v; }, i));
+    }
+    // 不带令牌的任务不受影响
+    std::future<int> plain = pool.submitTask([](){ return 7; });
+
+    source.cancel();
+    gate.set_value();
+    blocker.get();
+
+    for(auto& f : results)
+    {
+        if(!isCancelledFuture(f))
+            return false;
+    }
+    return ran == 0 && plain.get() == 7;
+}
+
+// 令牌已经取消时提交，任务不入队，future直接以TaskCancelled结束
+bool testAlreadyCancelled(ThreadPool& pool)
+{
+    CancellationSource source;
+    source.cancel();
+    bool ran = false;
+    std::future<void> f = pool.submitTask(source.token(), [&ran](){ ran = true; });
+    if(f.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+    return isCancelledFuture(f) && !ran;
+}
+
+// 队列满时提交被拒绝，future以TaskCancelled结束，之后取消同一个令牌不受影响
+bool testRejected()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.start(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::future<void> blocker = pool.submitTask([opened](){ opened.wait(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    CancellationSource source;
+    std::future<int> queued = pool.submitTask(source.token(), [](){ return 1; });
+    std::future<int> rejected = pool.submitTask(source.token(), [](){ return 2; });
+    bool ok = isCancelledFuture(rejected);
+    gate.set_value();
+    blocker.get();
+    ok = ok && queued.get() == 1;
+    source.cancel();
+    return ok;
+}
+
+// 已经开始执行的任务不会被打断，通过isCancelled()轮询提前结束，future正常返回
+bool testRunning(ThreadPool& pool)
+{
+    CancellationSource source;
+    CancellationToken token = source.token();
+    std::atomic_bool started(false);
+    std::future<int> f = pool.submitTask(token, [token, &started]()
+    {
+        started = true;
+        int loops = 0;
+        while(!token.isCancelled())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            loops++;
+        }
+        return loops;
+    });
+    while(!started)
+    {
+        std::this_thread::yield();
+    }
+    source.cancel();
+    try
+    {
+        f.get();
+    }
+    catch(...)
+    {
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    std::cout.rdbuf(nullptr); // 线程池每个任务都会打印，关掉
+
+    ThreadPool pool;
+    pool.start(1);
+
+    int failed = 0;
+    if(!testQueued(pool))
+    {
+        std::cerr << "queued fail" << std::endl;
+        failed++;
+    }
+    if(!testAlreadyCancelled(pool))
+    {
+        std::cerr << "already cancelled fail" << std::endl;
+        failed++;
+    }
+    if(!testRejected())
+    {
+        std::cerr << "rejected fail" << std::endl;
+        failed++;
+    }
+    if(!testRunning(pool))
+    {
+        std::cerr << "running fail" << std::endl;
+        failed++;
+    }
+
+    std::cerr << (failed == 0 ? "cancel ok" : "cancel fail") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <optional>
+#include <stdexcept>
+
+#include "channel.h"
+
+// 通道测试：有界背压、关闭语义、consume、Select、只能移动的元素、回调抛异常、线程池队列满时回调不丢
+// 编译: g++ -std=c++17 -pthread main_channel.cpp threadpool_2.cpp -o main_channel
+
+// 容量为2的通道，第三次发送阻塞到有人接收
+bool testBackpressure()
+{
+    Channel<int> ch(2);
+    if(!ch.send(1) || !ch.send(2))
+        return false;
+    int v = 3;
+    if(ch.trySend(v))
+        return false; // 已满
+
+    std::atomic_bool sent(false);
+    std::thread producer([&](){ ch.send(3); sent = true; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if(sent)
+    {
+        producer.join();
+        return false;
+    }
+    int out = 0;
+    ch.recv(out);
+    producer.join();
+    return out == 1 && sent && ch.size() == 2;
+}
+
+// 关闭后不能发送，剩余数据仍可读完，读空后recv返回false，等待中的异步接收方收到std::nullopt
+bool testClose(ThreadPool& pool)
+{
+    Channel<int> ch(4);
+    ch.send(1);
+    ch.send(2);
+    ch.close();
+    if(ch.send(3) || !ch.isClosed())
+        return false;
+    int a = 0, b = 0, c = 0;
+    if(!ch.recv(a) || !ch.recv(b) || ch.recv(c) || a != 1 || b != 2)
+        return false;
+
+    Channel<int> empty;
+    std::promise<bool> got;
+    empty.asyncRecv(pool, [&got](std::optional<int> v){ got.set_value(!v.has_value()); });
+    std::promise<bool> sendResult;
+    Channel<int> full(1);
+    full.send(0);
+    full.asyncSend(pool, 1, [&sendResult](bool ok){ sendResult.set_value(ok); });
+    empty.close();
+    full.close();
+    return got.get_future().get() && !sendResult.get_future().get();
+}
+
+// 生产者任务不断发送，consume在线程池上逐个处理，关闭后done被调用
+bool testConsume(ThreadPool& pool)
+{
+    Channel<int> ch(8);
+    long long sum = 0;
+    std::promise<void> done;
+    ch.consume(pool, [&sum](int v){ sum += v; }, [&done](){ done.set_value(); });
+    pool.submitTask([&ch]()
+    {
+        for(int i = 1; i <= 1000; i++)
+            ch.send(i);
+        ch.close();
+    });
+    done.get_future().get();
+    return sum == 1000LL * 1001 / 2;
+}
+
+// 两个通道上Select，只有先就绪的分支执行
+bool testSelect(ThreadPool& pool)
+{
+    Channel<int> a;
+    Channel<std::string> b;
+    std::atomic_int fired(0);
+    std::promise<std::string> result;
+    Select().onRecv<int>(a, [&](std::optional<int>){ fired++; result.set_value("a"); })
+            .onRecv<std::string>(b, [&](std::optional<std::string> s){ fired++; result.set_value(*s); })
+            .run(pool);
+    b.send("b");
+    std::string which = result.get_future().get();
+    a.send(1); // 已作废的分支不再执行，数据留在通道里
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return which == "b" && fired == 1 && a.size() == 1;
+}
+
+// 只能移动的元素
+bool testMoveOnly(ThreadPool& pool)
+{
+    Channel<std::unique_ptr<int>> ch(4);
+    ch.send(std::make_unique<int>(41));
+    std::promise<int> got;
+    ch.asyncRecv(pool, [&got](std::optional<std::unique_ptr<int>> p){ got.set_value(**p + 1); });
+    std::unique_ptr<int> q = std::make_unique<int>(5);
+    ch.trySend(q);
+    std::unique_ptr<int> out;
+    return got.get_future().get() == 42 && ch.recv(out) && *out == 5 && q == nullptr;
+}
+
+// 线程池队列满，回调提交失败时在当前线程执行，交出的数据不丢
+bool testPoolFull()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.start(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    pool.submitTask([opened](){ opened.wait(); }); // 占住唯一的线程
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pool.submitTask([](){});                       // 占满队列
+
+    Channel<int> ch;
+    int received = -1;
+    ch.asyncRecv(pool, [&received](std::optional<int> v){ received = *v; });
+    ch.send(7); // 提交回调等待1s失败，在这里直接执行
+    gate.set_value();
+    return received == 7;
+}
+
+// 异步接收回调抛出的异常不会从发送方的send()/close()里冒出来
+bool testThrowingCallback(ThreadPool& pool)
+{
+    std::atomic_int calls(0);
+    for(int i = 0; i < 2000; i++)
+    {
+        Channel<int> ch;
+        ch.asyncRecv(pool, [&calls](std::optional<int>){ calls++; throw std::runtime_error("callback"); });
+        try
+        {
+            ch.send(i);
+            ch.close();
+        }
+        catch(...)
+        {
+            return false;
+        }
+    }
+    while(calls < 2000)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+int main()
+{
+    std::cout.rdbuf(nullptr); // 线程池每个任务都会打印，关掉
+
+    ThreadPool pool;
+    pool.start(4);
+
+    int failed = 0;
+    if(!testBackpressure())
+    {
+        std::cerr << "backpressure fail" << std::endl;
+        failed++;
+    }
+    if(!testClose(pool))
+    {
+        std::cerr << "close fail" << std::endl;
+        failed++;
+    }
+    if(!testConsume(pool))
+    {
+        std::cerr << "consume fail" << std::endl;
+        failed++;
+    }
+    if(!testSelect(pool))
+    {
+        std::cerr << "select fail" << std::endl;
+        failed++;
+    }
+    if(!testMoveOnly(pool))
+    {
+        std::cerr << "move only fail" << std::endl;
+        failed++;
+    }
+    if(!testThrowingCallback(pool))
+    {
+        std::cerr << "throwing callback fail" << std::endl;
+        failed++;
+    }
+    if(!testPoolFull())
+    {
+        std::cerr << "pool full fail" << std::endl;
+        failed++;
+    }
+
+    std::cerr << (failed == 0 ? "channel ok" : "channel fail") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ioexecutor.h"
+
+// 异步文件IO测试：io_uring（逐个提交/批量提交）和线程池退化方案各跑一遍
+// 写入后fsync，再用续接读回校验；续接抛异常；错误返回-errno；超过单次上限的请求返回部分长度而不是被截断
+// 编译: g++ -std=c++17 -pthread main_io.cpp ioexecutor.cpp threadpool_2.cpp -o main_io
+
+const int BLOCK_COUNT = 4000;
+const int BLOCK_SIZE = 512;
+
+bool runOnce(ThreadPool& pool, bool useUring, unsigned batch)
+{
+    char path[] = "/tmp/ioexecutorXXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0)
+        return false;
+    unlink(path);
+
+    bool ok = true;
+    {
+        IoExecutor io(pool, 64, useUring);
+        io.setBatchSize(batch);
+
+        std::vector<std::vector<char>> writeBufs(BLOCK_COUNT, std::vector<char>(BLOCK_SIZE));
+        std::vector<std::future<ssize_t>> writes;
+        for(int i = 0; i < BLOCK_COUNT; i++)
+        {
+            memset(writeBufs[i].data(), 'a' + i % 26, BLOCK_SIZE);
+            writes.push_back(io.asyncWrite(fd, writeBufs[i].data(), BLOCK_SIZE, (off_t)i * BLOCK_SIZE));
+        }
+        io.flush();
+        for(auto& f : writes)
+        {
+            if(f.get() != BLOCK_SIZE)
+                ok = false;
+        }
+        if(io.asyncFsync(fd).get() != 0)
+            ok = false;
+
+        // 续接在线程池上执行
+        std::vector<std::vector<char>> readBufs(BLOCK_COUNT, std::vector<char>(BLOCK_SIZE));
+        std::atomic_int matched(0);
+        std::atomic_int done(0);
+        for(int i = 0; i < BLOCK_COUNT; i++)
+        {
+            io.asyncRead(fd, readBufs[i].data(), BLOCK_SIZE, (off_t)i * BLOCK_SIZE, [&, i](ssize_t res)
+            {
+                if(res == BLOCK_SIZE && readBufs[i][BLOCK_SIZE - 1] == 'a' + i % 26)
+                    matched++;
+                done++;
+            });
+        }
+        io.flush();
+        while(done < BLOCK_COUNT)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if(matched != BLOCK_COUNT)
+            ok = false;
+
+        // 续接抛出异常不影响进程和析构
+        std::atomic_int thrown(0);
+        for(int i = 0; i < 8; i++)
+        {
+            io.asyncWrite(fd, writeBufs[i].data(), BLOCK_SIZE, (off_t)i * BLOCK_SIZE, [&thrown](ssize_t)
+            {
+                thrown++;
+                throw std::runtime_error("continuation");
+            });
+        }
+        io.flush();
+        while(thrown < 8)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // 错误以-errno返回
+        char c;
+        if(io.asyncRead(-1, &c, 1, 0).get() != -EBADF)
+            ok = false;
+
+        // 4GiB以上的请求不能被截断成很小的长度：文件只有这么长时应读满整个文件
+        size_t hugeLen = (4ULL << 30) + 10;
+        void* huge = mmap(nullptr, hugeLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(huge != MAP_FAILED)
+        {
+            if(io.asyncRead(fd, huge, hugeLen, 0).get() != (ssize_t)BLOCK_COUNT * BLOCK_SIZE)
+                ok = false;
+            munmap(huge, hugeLen);
+        }
+
+        std::cerr << "uring=" << io.usingUring() << " batch=" << batch << (ok ? " ok" : " fail") << std::endl;
+    }
+    close(fd);
+    return ok;
+}
+
+int main()
+{
+    std::cout.rdbuf(nullptr); // 线程池每个任务都会打印，关掉
+
+    ThreadPool pool;
+    pool.start(2);
+
+    int failed = 0;
+    if(!runOnce(pool, true, 1))
+        failed++;
+    if(!runOnce(pool, true, 16))
+        failed++;
+    if(!runOnce(pool, false, 1))
+        failed++;
+
+    std::cerr << (failed == 0 ? "io ok" : "io fail") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
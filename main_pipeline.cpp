@@ -0,0 +1,161 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <optional>
+
+#include "pipeline.h"
+
+// 流水线测试：并行阶段之后按顺序输出、异常从run()重新抛出、只能移动的元素、任务队列满
+// 编译: g++ -std=c++17 -pthread main_pipeline.cpp threadpool_2.cpp -o main_pipeline
+
+// 并行阶段打乱完成顺序，SERIAL_IN_ORDER的sink仍按source顺序收到
+bool testInOrder(ThreadPool& pool)
+{
+    const int N = 500;
+    int next = 0;
+    std::vector<int> out;
+    Pipeline pipe(pool, 8);
+    pipe.source([&]()->std::optional<int>
+        {
+            if(next >= N)
+                return std::nullopt;
+            return next++;
+        })
+        .stage<int>(StageMode::PARALLEL, [](int v)
+        {
+            thread_local std::mt19937 rng(std::random_device{}());
+            std::this_thread::sleep_for(std::chrono::microseconds(rng() % 200));
+            return v * 2;
+        })
+        .stage<int>(StageMode::SERIAL_IN_ORDER, [&](int v){ out.push_back(v); });
+    pipe.run();
+
+    if((int)out.size() != N)
+        return false;
+    for(int i = 0; i < N; i++)
+    {
+        if(out[i] != i * 2)
+            return false;
+    }
+    return true;
+}
+
+// 阶段抛出的第一个异常由run()重新抛出，之后不再产生新元素
+bool testException(ThreadPool& pool)
+{
+    int next = 0;
+    Pipeline pipe(pool, 4);
+    pipe.source([&]()->std::optional<int>
+        {
+            if(next >= 1000)
+                return std::nullopt;
+            return next++;
+        })
+        .stage<int>(StageMode::PARALLEL, [](int v)
+        {
+            if(v == 100)
+                throw std::runtime_error("bad item");
+            return v;
+        })
+        .stage<int>(StageMode::SERIAL_OUT_OF_ORDER, [](int){});
+    try
+    {
+        pipe.run();
+    }
+    catch(const std::runtime_error& e)
+    {
+        return std::string(e.what()) == "bad item" && next < 1000;
+    }
+    return false;
+}
+
+// 只能移动的元素在阶段之间传递
+bool testMoveOnly(ThreadPool& pool)
+{
+    int next = 0;
+    long long sum = 0;
+    Pipeline pipe(pool, 8);
+    pipe.source([&]()->std::optional<std::unique_ptr<int>>
+        {
+            if(next >= 100)
+                return std::nullopt;
+            return std::make_unique<int>(next++);
+        })
+        .stage<std::unique_ptr<int>>(StageMode::PARALLEL, [](std::unique_ptr<int> p)
+        {
+            *p += 1;
+            return p;
+        })
+        .stage<std::unique_ptr<int>>(StageMode::SERIAL_IN_ORDER, [&](std::unique_ptr<int> p){ sum += *p; });
+    pipe.run();
+    return sum == 100 * 101 / 2;
+}
+
+// 任务队列上限小于token数且唯一的线程被占住，提交被拒绝的槽位在当前线程执行，run()仍然完成
+bool testQueueFull()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(2);
+    pool.start(1);
+    pool.submitTask([](){ std::this_thread::sleep_for(std::chrono::milliseconds(1500)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    int next = 0;
+    std::vector<int> out;
+    Pipeline pipe(pool, 8);
+    pipe.source([&]()->std::optional<int>
+        {
+            if(next >= 200)
+                return std::nullopt;
+            return next++;
+        })
+        .stage<int>(StageMode::PARALLEL, [](int v){ return v + 1; })
+        .stage<int>(StageMode::SERIAL_IN_ORDER, [&](int v){ out.push_back(v); });
+    pipe.run();
+
+    if((int)out.size() != 200)
+        return false;
+    for(int i = 0; i < 200; i++)
+    {
+        if(out[i] != i + 1)
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    std::cout.rdbuf(nullptr); // 线程池每个任务都会打印，关掉
+
+    ThreadPool pool;
+    pool.start(4);
+
+    int failed = 0;
+    if(!testInOrder(pool))
+    {
+        std::cerr << "in order fail" << std::endl;
+        failed++;
+    }
+    if(!testException(pool))
+    {
+        std::cerr << "exception fail" << std::endl;
+        failed++;
+    }
+    if(!testMoveOnly(pool))
+    {
+        std::cerr << "move only fail" << std::endl;
+        failed++;
+    }
+    if(!testQueueFull())
+    {
+        std::cerr << "queue full fail" << std::endl;
+        failed++;
+    }
+
+    std::cerr << (failed == 0 ? "pipeline ok" : "pipeline fail") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
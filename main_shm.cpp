@@ -0,0 +1,111 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "shmoffload.h"
+
+// 两个本地进程之间通过共享内存转移任务：父进程发起，子进程在自己的线程池里执行
+// 编译: g++ -std=c++17 -pthread main_shm.cpp shmoffload.cpp threadpool_2.cpp -o main_shm -lrt
+
+const char* SHM_NAME = "/threadpool_shm_demo";
+const uint32_t FUNC_SUM = 1;   // 负载为若干int，返回它们的和
+const uint32_t FUNC_UPPER = 2; // 负载为字符串，返回大写
+
+int runServer()
+{
+    ThreadPool pool;
+    pool.start(4);
+
+    // 等发起方创建好共享内存
+    std::unique_ptr<ShmTaskServer> server;
+    for(int i = 0; i < 500; i++)
+    {
+        server = std::make_unique<ShmTaskServer>(SHM_NAME, pool);
+        if(server->isValid())
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if(!server->isValid())
+    {
+        std::cerr << "open shared memory fail." << std::endl;
+        return 1;
+    }
+
+    server->registerHandler(FUNC_SUM, [](const std::string& payload)->std::string
+    {
+        long long sum = 0;
+        for(size_t i = 0; i + sizeof(int) <= payload.size(); i += sizeof(int))
+        {
+            int v;
+            memcpy(&v, payload.data() + i, sizeof(int));
+            sum += v;
+        }
+        return std::string(reinterpret_cast<const char*>(&sum), sizeof(sum));
+    });
+    server->registerHandler(FUNC_UPPER, [](const std::string& payload)->std::string
+    {
+        std::string out = payload;
+        for(char& c : out)
+            c = toupper(c);
+        return out;
+    });
+    server->start();
+    server->wait(); // 发起方关闭后返回
+    return 0;
+}
+
+int main()
+{
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        return runServer();
+    }
+
+    int failed = 0;
+    {
+        ShmTaskClient client(SHM_NAME, 256);
+        if(!client.isValid())
+        {
+            kill(pid, SIGTERM);
+            return 1;
+        }
+
+        std::vector<std::future<ShmReply>> sums;
+        for(int i = 0; i < 200; i++)
+        {
+            int data[4] = {i, i + 1, i + 2, i + 3};
+            sums.push_back(client.offload(FUNC_SUM, data, sizeof(data)));
+        }
+        std::future<ShmReply> upper = client.offload(FUNC_UPPER, "hello", 5);
+        std::future<ShmReply> unknown = client.offload(99, "", 0);
+
+        for(int i = 0; i < 200; i++)
+        {
+            ShmReply r = sums[i].get();
+            long long sum = 0;
+            if(r.status == SHM_STATUS_OK)
+                memcpy(&sum, r.data.data(), sizeof(sum));
+            if(r.status == SHM_STATUS_FULL)
+                continue; // 环满时正常做法是在本地执行
+            if(r.status != SHM_STATUS_OK || sum != 4LL * i + 6)
+                failed++;
+        }
+        ShmReply u = upper.get();
+        if(u.status != SHM_STATUS_OK || u.data != "HELLO")
+            failed++;
+        if(unknown.get().status != SHM_STATUS_NO_HANDLER)
+            failed++;
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    std::cerr << (failed == 0 ? "offload ok" : "offload fail") << std::endl;
+    return failed == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <future>
+
+#include "threadpool_2.h"
+
+// 多租户测试：繁忙时按权重分配、子队列上限拒绝、不设上限的租户占不满任务队列、删除租户、统计信息
+// 编译: g++ -std=c++17 -pthread main_tenant.cpp threadpool_2.cpp -o main_tenant
+
+// 占住线程池唯一的线程，返回放行用的promise
+std::promise<void> block(ThreadPool& pool)
+{
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    pool.submitTask([opened](){ opened.wait(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return gate;
+}
+
+// 两个租户权重3:1，同时积压时前40个任务里租户1约占3/4
+bool testWeightedShare(ThreadPool& pool)
+{
+    pool.addTenant(1, 3);
+    pool.addTenant(2, 1);
+    std::promise<void> gate = block(pool);
+
+    std::mutex mtx;
+    std::vector<int> order;
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < 40; i++)
+    {
+        results.push_back(pool.submitTask(Tenant{1}, [&](){ std::lock_guard<std::mutex> lock(mtx); order.push_back(1); }));
+        results.push_back(pool.submitTask(Tenant{2}, [&](){ std::lock_guard<std::mutex> lock(mtx); order.push_back(2); }));
+    }
+    gate.set_value();
+    for(auto& f : results)
+        f.get();
+
+    int first = 0;
+    for(int i = 0; i < 40; i++)
+    {
+        if(order[i] == 1)
+            first++;
+    }
+    TenantStats s1 = pool.getTenantStats(1);
+    TenantStats s2 = pool.getTenantStats(2);
+    return first >= 28 && first <= 32
+        && s1.weight == 3 && s1.submitted == 40 && s1.dispatched == 40 && s1.queued == 0
+        && s2.weight == 1 && s2.submitted == 40 && s2.dispatched == 40 && s2.rejected == 0;
+}
+
+// 租户子队列上限为2，第3个任务等待1s后被拒绝，返回默认值；其他租户不受影响
+bool testQueueLimit(ThreadPool& pool)
+{
+    pool.addTenant(3, 1, 2);
+    std::promise<void> gate = block(pool);
+
+    std::future<int> a = pool.submitTask(Tenant{3}, [](){ return 1; });
+    std::future<int> b = pool.submitTask(Tenant{3}, [](){ return 2; });
+    std::future<int> c = pool.submitTask(Tenant{3}, [](){ return 3; });
+    std::future<int> other = pool.submitTask(Tenant{4}, [](){ return 4; });
+    TenantStats queued = pool.getTenantStats(3);
+    gate.set_value();
+
+    bool ok = a.get() == 1 && b.get() == 2 && c.get() == 0 && other.get() == 4;
+    TenantStats s = pool.getTenantStats(3);
+    return ok && queued.queued == 2 && queued.queueLimit == 2
+        && s.submitted == 2 && s.rejected == 1 && s.dispatched == 2
+        && pool.getTenantStats(99).submitted == 0; // 不存在的租户各项为0
+}
+
+// 任务队列上限10，两个租户都没有设子队列上限：租户7灌满时只能占一半，租户8的任务仍然能立即入队
+bool testFlood()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(10);
+    pool.start(1);
+    pool.addTenant(7);
+    pool.addTenant(8);
+    std::promise<void> gate = block(pool);
+
+    std::vector<std::future<int>> flood;
+    for(int i = 0; i < 6; i++)
+        flood.push_back(pool.submitTask(Tenant{7}, [i](){ return i + 1; }));
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::future<int>> others;
+    for(int i = 0; i < 5; i++)
+        others.push_back(pool.submitTask(Tenant{8}, [i](){ return i + 1; }));
+    bool fast = std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(500);
+    bool removeBusy = pool.removeTenant(8); // 还有排队的任务，不能删除
+    gate.set_value();
+
+    bool ok = fast && !removeBusy;
+    for(int i = 0; i < 6; i++)
+        ok = ok && flood[i].get() == (i < 5 ? i + 1 : 0);
+    for(int i = 0; i < 5; i++)
+        ok = ok && others[i].get() == i + 1;
+    TenantStats s7 = pool.getTenantStats(7);
+    TenantStats s8 = pool.getTenantStats(8);
+    ok = ok && s7.submitted == 5 && s7.rejected == 1 && s8.submitted == 5 && s8.rejected == 0;
+
+    // 任务都取走后可以删除，默认租户不能删除
+    ok = ok && pool.removeTenant(8) && pool.getTenantStats(8).submitted == 0
+        && !pool.removeTenant(DEFAULT_TENANT) && !pool.removeTenant(99);
+    return ok;
+}
+
+int main()
+{
+    std::cout.rdbuf(nullptr); // 线程池每个任务都会打印，关掉
+
+    ThreadPool pool;
+    pool.start(1);
+
+    int failed = 0;
+    if(!testWeightedShare(pool))
+    {
+        std::cerr << "weighted share fail" << std::endl;
+        failed++;
+    }
+    if(!testQueueLimit(pool))
+    {
+        std::cerr << "queue limit fail" << std::endl;
+        failed++;
+    }
+    if(!testFlood())
+    {
+        std::cerr << "flood fail" << std::endl;
+        failed++;
+    }
+
+    std::cerr << (failed == 0 ? "tenant ok" : "tenant fail") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <future>
+#include <stdexcept>
+
+#include "workerlocal.h"
+
+// 工作线程本地值测试：懒创建、forEach合并、线程池析构时onRetire、线程池外get()、启动/退出回调
+// 编译: g++ -std=c++17 -pthread main_workerlocal.cpp threadpool_2.cpp -o main_workerlocal
+
+const int THREAD_COUNT = 4;
+const int TASK_COUNT = 10000;
+
+int main()
+{
+    std::cout.rdbuf(nullptr); // 线程池每个任务都会打印，关掉
+
+    int failed = 0;
+    std::mutex mtx;
+    std::set<int> started, stopped;
+    std::atomic_int created(0);
+    std::atomic<long long> retiredSum(0);
+    auto pool = std::make_unique<ThreadPool>();
+
+    // 回调在工作线程上执行，上下文里的线程id和参数一致
+    std::atomic_bool contextOk(true);
+    pool->onWorkerStart([&](int id)
+    {
+        WorkerContext* context = ThreadPool::currentWorker();
+        if(context == nullptr || context->workerId() != id)
+            contextOk = false;
+        std::lock_guard<std::mutex> lock(mtx);
+        started.insert(id);
+    });
+    pool->onWorkerStop([&](int id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopped.insert(id);
+    });
+
+    // 每个线程的部分和，线程退出时合并到retiredSum
+    WorkerLocal<long long> partial(*pool,
+        [&](){ created++; return std::make_unique<long long>(0); },
+        [&](int, long long& v){ retiredSum += v; });
+    // 复用的临时缓冲区
+    WorkerLocal<std::vector<char>> scratch(*pool, [](){ return std::make_unique<std::vector<char>>(1 << 16); });
+
+    pool->start(THREAD_COUNT);
+
+    std::vector<std::future<void>> results;
+    for(int i = 1; i <= TASK_COUNT; i++)
+    {
+        results.push_back(pool->submitTask([&, i]()
+        {
+            std::vector<char>& buf = scratch.get();
+            buf[i % buf.size()] = 1;
+            partial.get() += i;
+        }));
+    }
+    for(auto& f : results)
+        f.get();
+
+    // 懒创建：每个线程最多一份
+    if(created > THREAD_COUNT || (int)partial.size() != created || (int)scratch.size() > THREAD_COUNT)
+    {
+        std::cerr << "lazy creation fail" << std::endl;
+        failed++;
+    }
+
+    // 任务都完成后合并，不需要原子变量
+    long long total = 0;
+    partial.forEach([&total](int, long long& v){ total += v; });
+    if(total != (long long)TASK_COUNT * (TASK_COUNT + 1) / 2)
+    {
+        std::cerr << "forEach fail" << std::endl;
+        failed++;
+    }
+
+    // 线程池外调用get()抛出logic_error，其他线程池的任务里也一样
+    bool outside = false;
+    try
+    {
+        partial.get();
+    }
+    catch(const std::logic_error&)
+    {
+        outside = true;
+    }
+    ThreadPool other;
+    other.start(1);
+    std::future<bool> otherPool = other.submitTask([&partial]()
+    {
+        try
+        {
+            partial.get();
+        }
+        catch(const std::logic_error&)
+        {
+            return true;
+        }
+        return false;
+    });
+    if(!outside || !otherPool.get())
+    {
+        std::cerr << "outside pool fail" << std::endl;
+        failed++;
+    }
+
+    // 每个作业一个WorkerLocal，用完就销毁
+    for(int job = 0; job < 200; job++)
+    {
+        WorkerLocal<int> counter(*pool);
+        std::vector<std::future<void>> jobResults;
+        for(int i = 0; i < 8; i++)
+            jobResults.push_back(pool->submitTask([&counter](){ counter.get()++; }));
+        for(auto& f : jobResults)
+            f.get();
+        int sum = 0;
+        counter.forEach([&sum](int, int& v){ sum += v; });
+        if(sum != 8)
+        {
+            std::cerr << "per job fail" << std::endl;
+            failed++;
+            break;
+        }
+    }
+
+    // 线程池析构：每个线程退出时调用退出回调，值经onRetire合并后销毁
+    pool.reset();
+    if(retiredSum != total || partial.size() != 0 || scratch.size() != 0)
+    {
+        std::cerr << "retire fail" << std::endl;
+        failed++;
+    }
+    if(!contextOk || (int)started.size() != THREAD_COUNT || stopped != started)
+    {
+        std::cerr << "hooks fail" << std::endl;
+        failed++;
+    }
+
+    std::cerr << (failed == 0 ? "workerlocal ok" : "workerlocal fail") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
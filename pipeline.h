@@ -0,0 +1,331 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+#include "threadpool_2.h"
+
+// 基于ThreadPool的流水线：source -> stage -> ... -> sink
+// 同时在飞的token数量有上限，sink慢时source自然停下来（背压）
+//
+//  Pipeline pipe(pool, 16);
+//  pipe.source([&]()->std::optional<std::string>{ ... 返回std::nullopt表示结束 ... })
+//      .stage<std::string>(StageMode::PARALLEL, [](std::string line){ return parse(line); })
+//      .stage<Record>(StageMode::SERIAL_IN_ORDER, [&](Record r){ write(r); });
+//  pipe.run();
+//
+// 注意：run()会阻塞等待，不要在同一个线程池的任务里调用；线程池任务队列满时槽位在提交方线程上直接执行，
+// 不会丢失，但要等待队列超时，token数最好不超过任务队列上限
+
+// 流水线阶段的类型
+enum class StageMode
+{
+    SERIAL_IN_ORDER,     // 串行，按source产生的顺序处理
+    SERIAL_OUT_OF_ORDER, // 串行，先到先处理
+    PARALLEL,            // 可并行处理
+};
+
+class Pipeline
+{
+public:
+    Pipeline(ThreadPool& pool, int maxTokens = 8)
+        : pool_(pool)
+        , maxTokens_(maxTokens > 0 ? maxTokens : 1)
+        , activeSlots_(0)
+        , nextSeq_(0)
+        , sourceDone_(false)
+        , stopped_(false)
+    {}
+    ~Pipeline() = default;
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // 设置数据源，每次调用返回一个元素，返回std::nullopt表示数据结束；source总是串行调用
+    template<typename Func>
+    Pipeline& source(Func&& func)
+    {
+        using OptType = std::invoke_result_t<Func>;
+        using T = typename OptType::value_type;
+        source_ = [func = std::forward<Func>(func)](Item& item) mutable -> bool
+        {
+            OptType v = func();
+            if(!v)
+                return false;
+            item.put<T>(std::move(*v));
+            return true;
+        };
+        return *this;
+    }
+
+    // 添加一个阶段，In为上一阶段的输出类型；返回void的阶段即为sink
+    template<typename In, typename Func>
+    Pipeline& stage(StageMode mode, Func&& func)
+    {
+        using Out = std::invoke_result_t<Func, In>;
+        auto st = std::make_unique<Stage>(mode);
+        if constexpr (std::is_void_v<Out>)
+        {
+            st->fn = [func = std::forward<Func>(func)](Item& item) mutable
+            {
+                func(item.take<In>());
+            };
+        }
+        else
+        {
+            st->fn = [func = std::forward<Func>(func)](Item& item) mutable
+            {
+                item.put<Out>(func(item.take<In>()));
+            };
+        }
+        stages_.push_back(std::move(st));
+        return *this;
+    }
+
+    // 运行流水线直到source结束且所有token处理完，阶段中抛出的第一个异常会在这里重新抛出
+    void run()
+    {
+        if(!source_)
+            throw std::logic_error("pipeline has no source");
+
+        for(auto& st : stages_)
+        {
+            st->busy = false;
+            st->nextSeq = 0;
+        }
+        nextSeq_ = 0;
+        sourceDone_ = false;
+        stopped_ = false;
+        error_ = nullptr;
+        activeSlots_ = maxTokens_;
+
+        // 每个槽位就是一个token，处理完最后一个阶段后回到source取下一个元素；提交失败时在当前线程执行
+        for(int i = 0; i < maxTokens_; i++)
+        {
+            pool_.submitOrRun([this](){ drive(nullptr, 0, false); });
+        }
+
+        std::unique_lock<std::mutex> lock(doneMtx_);
+        doneCond_.wait(lock, [&]()->bool{return activeSlots_ == 0;});
+        if(error_)
+            std::rethrow_exception(error_);
+    }
+
+private:
+    // 在阶段之间传递的元素，只移动不拷贝
+    class Item
+    {
+    public:
+        template<typename T>
+        void put(T data)
+        {
+            base_ = std::make_unique<Derive<T>>(std::move(data));
+        }
+
+        template<typename T>
+        T take()
+        {
+            Derive<T>* d = dynamic_cast<Derive<T>*>(base_.get());
+            if(d == nullptr)
+                throw std::invalid_argument("pipeline stage input type is unmatch!");
+            T data = std::move(d->data_);
+            base_.reset();
+            return data;
+        }
+    private:
+        class Base
+        {
+        public:
+            virtual ~Base() = default;
+        };
+
+        template<typename T>
+        class Derive : public Base
+        {
+        public:
+            Derive(T data) : data_(std::move(data)) {}
+            T data_;
+        };
+
+        std::unique_ptr<Base> base_;
+    };
+
+    struct Token
+    {
+        size_t seq = 0;      // source产生的序号，SERIAL_IN_ORDER阶段按它排序
+        bool failed = false; // 出错的token不再执行阶段函数，但仍按序经过串行阶段
+        Item item;
+    };
+    using TokenPtr = std::shared_ptr<Token>;
+
+    struct Stage
+    {
+        Stage(StageMode m) : mode(m) {}
+
+        StageMode mode;
+        std::function<void(Item&)> fn;
+
+        std::mutex mtx;                       // 保护下面的串行阶段状态
+        bool busy = false;                    // 是否有token正在执行本阶段
+        size_t nextSeq = 0;                   // SERIAL_IN_ORDER：下一个允许进入的序号
+        std::map<size_t, TokenPtr> waiting;   // SERIAL_IN_ORDER：提前到达的token
+        std::deque<TokenPtr> pending;         // SERIAL_OUT_OF_ORDER：排队的token
+    };
+
+    // 槽位主循环：先把手上的token推进完，再不断从source取新元素
+    void drive(TokenPtr tok, size_t from, bool admitted)
+    {
+        if(tok && !process(tok, from, admitted))
+            return; // token停在串行阶段，槽位随token一起交给释放该阶段的线程
+
+        for(;;)
+        {
+            tok = std::make_shared<Token>();
+            {
+                std::lock_guard<std::mutex> lock(sourceMtx_);
+                if(sourceDone_ || stopped_)
+                    break;
+                try
+                {
+                    if(!source_(tok->item))
+                    {
+                        sourceDone_ = true;
+                        break;
+                    }
+                }
+                catch(...)
+                {
+                    setError(std::current_exception());
+                    sourceDone_ = true;
+                    break;
+                }
+                tok->seq = nextSeq_++;
+            }
+            if(!process(tok, 0, false))
+                return;
+        }
+
+        std::lock_guard<std::mutex> lock(doneMtx_);
+        if(--activeSlots_ == 0)
+            doneCond_.notify_all();
+    }
+
+    // 在当前线程上把token依次推进各阶段，保持缓存局部性；返回false表示token被挂起
+    bool process(const TokenPtr& tok, size_t from, bool admitted)
+    {
+        for(size_t i = from; i < stages_.size(); i++)
+        {
+            Stage& st = *stages_[i];
+            bool serial = st.mode != StageMode::PARALLEL;
+            if(serial && !admitted && !enterSerial(st, tok))
+                return false;
+            admitted = false;
+
+            if(!tok->failed && !stopped_)
+            {
+                try
+                {
+                    st.fn(tok->item);
+                }
+                catch(...)
+                {
+                    setError(std::current_exception());
+                }
+            }
+            if(stopped_)
+                tok->failed = true;
+
+            if(serial)
+            {
+                // 串行阶段空出来后，把下一个等待的token交给线程池继续执行，队列满时在当前线程接着执行
+                TokenPtr next = leaveSerial(st);
+                if(next)
+                    pool_.submitOrRun([this, next, i](){ drive(next, i, true); });
+            }
+        }
+        return true;
+    }
+
+    bool enterSerial(Stage& st, const TokenPtr& tok)
+    {
+        std::lock_guard<std::mutex> lock(st.mtx);
+        if(st.mode == StageMode::SERIAL_IN_ORDER)
+        {
+            if(!st.busy && tok->seq == st.nextSeq)
+            {
+                st.busy = true;
+                return true;
+            }
+            st.waiting.emplace(tok->seq, tok);
+            return false;
+        }
+        if(!st.busy)
+        {
+            st.busy = true;
+            return true;
+        }
+        st.pending.push_back(tok);
+        return false;
+    }
+
+    // 离开串行阶段，返回下一个可以进入的token（阶段保持busy直接转交给它）
+    TokenPtr leaveSerial(Stage& st)
+    {
+        std::lock_guard<std::mutex> lock(st.mtx);
+        TokenPtr next;
+        if(st.mode == StageMode::SERIAL_IN_ORDER)
+        {
+            st.nextSeq++;
+            auto it = st.waiting.find(st.nextSeq);
+            if(it != st.waiting.end())
+            {
+                next = std::move(it->second);
+                st.waiting.erase(it);
+            }
+        }
+        else if(!st.pending.empty())
+        {
+            next = std::move(st.pending.front());
+            st.pending.pop_front();
+        }
+        st.busy = next != nullptr;
+        return next;
+    }
+
+    void setError(std::exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock(doneMtx_);
+        if(!error_)
+            error_ = e;
+        stopped_ = true;
+    }
+
+private:
+    ThreadPool& pool_;
+    int maxTokens_;       // 同时在飞的token上限
+    int activeSlots_;     // 还在运行的槽位数，为0时run()返回
+
+    std::function<bool(Item&)> source_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+
+    std::mutex sourceMtx_; // 保证source串行调用
+    size_t nextSeq_;
+    bool sourceDone_;
+
+    std::atomic_bool stopped_; // 出错后停止取新元素
+    std::exception_ptr error_;
+    std::mutex doneMtx_;
+    std::condition_variable doneCond_;
+};
+
+#endif
@@ -0,0 +1,476 @@
+#include "shmoffload.h"
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory ring needs lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory ring needs lock-free 32-bit atomics");
+
+const uint32_t SHM_MAGIC = 0x53484d54; // "SHMT"
+const int SHM_IDLE_SPIN = 64;          // 队列为空时先让出CPU的次数，之后改为睡眠
+
+// 队列为空时的退避：先yield，空转多了再短暂睡眠
+static void backoff(int& idle)
+{
+    if(++idle < SHM_IDLE_SPIN)
+    {
+        std::this_thread::yield();
+    }
+    else
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+////////////////  ShmRing方法实现
+size_t ShmRing::bytes(uint32_t capacity)
+{
+    return sizeof(Header) + sizeof(Cell) * capacity;
+}
+
+ShmRing::ShmRing(void* base, uint32_t capacity)
+    : header_(static_cast<Header*>(base))
+    , cells_(reinterpret_cast<Cell*>(static_cast<char*>(base) + sizeof(Header)))
+    , mask_(capacity - 1)
+{}
+
+void ShmRing::init()
+{
+    new (&header_->enqueuePos) std::atomic<uint64_t>(0);
+    new (&header_->dequeuePos) std::atomic<uint64_t>(0);
+    for(uint64_t i = 0; i <= mask_; i++)
+    {
+        new (&cells_[i].seq) std::atomic<uint64_t>(i);
+    }
+}
+
+bool ShmRing::tryPush(const ShmTaskDesc& desc)
+{
+    Cell* cell;
+    uint64_t pos = header_->enqueuePos.load(std::memory_order_relaxed);
+    for(;;)
+    {
+        cell = &cells_[pos & mask_];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        int64_t dif = (int64_t)seq - (int64_t)pos;
+        if(dif == 0)
+        {
+            if(header_->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0)
+        {
+            return false; // 满
+        }
+        else
+        {
+            pos = header_->enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->desc = desc;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool ShmRing::tryPop(ShmTaskDesc& desc)
+{
+    Cell* cell;
+    uint64_t pos = header_->dequeuePos.load(std::memory_order_relaxed);
+    for(;;)
+    {
+        cell = &cells_[pos & mask_];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        int64_t dif = (int64_t)seq - (int64_t)(pos + 1);
+        if(dif == 0)
+        {
+            if(header_->dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0)
+        {
+            return false; // 空
+        }
+        else
+        {
+            pos = header_->dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+    desc = cell->desc;
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+////////////////  ShmRegion方法实现
+struct ShmRegion::Header
+{
+    uint32_t magic;
+    uint32_t capacity;
+    std::atomic<uint32_t> ready;  // 创建方初始化完成后置1
+    std::atomic<uint32_t> closed; // 创建方关闭后置1
+    char pad[48];
+};
+
+ShmRegion::ShmRegion(const std::string& name, uint32_t capacity, bool create)
+    : name_(name)
+    , owner_(create)
+    , addr_(nullptr)
+    , size_(0)
+    , header_(nullptr)
+{
+    int fd = -1;
+    if(create)
+    {
+        // 容量向上取2的幂
+        uint32_t cap = 2;
+        while(cap < capacity)
+            cap <<= 1;
+        capacity = cap;
+
+        shm_unlink(name_.c_str());
+        fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0)
+        {
+            std::cerr << "shm_open " << name_ << " fail: " << strerror(errno) << std::endl;
+            return;
+        }
+        size_ = sizeof(Header) + 2 * ShmRing::bytes(capacity);
+        if(ftruncate(fd, size_) != 0)
+        {
+            std::cerr << "ftruncate " << name_ << " fail: " << strerror(errno) << std::endl;
+            ::close(fd);
+            shm_unlink(name_.c_str());
+            return;
+        }
+    }
+    else
+    {
+        fd = shm_open(name_.c_str(), O_RDWR, 0600);
+        if(fd < 0)
+            return; // 发起方可能还没创建，调用方可以重试
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+        {
+            ::close(fd);
+            return;
+        }
+        size_ = st.st_size;
+    }
+
+    void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED)
+    {
+        std::cerr << "mmap " << name_ << " fail: " << strerror(errno) << std::endl;
+        if(create)
+            shm_unlink(name_.c_str());
+        return;
+    }
+    addr_ = addr;
+    header_ = static_cast<Header*>(addr);
+    char* base = static_cast<char*>(addr) + sizeof(Header);
+
+    if(create)
+    {
+        header_->magic = SHM_MAGIC;
+        header_->capacity = capacity;
+        new (&header_->closed) std::atomic<uint32_t>(0);
+        requestRing_ = std::make_unique<ShmRing>(base, capacity);
+        replyRing_ = std::make_unique<ShmRing>(base + ShmRing::bytes(capacity), capacity);
+        requestRing_->init();
+        replyRing_->init();
+        new (&header_->ready) std::atomic<uint32_t>(0);
+        header_->ready.store(1, std::memory_order_release);
+        return;
+    }
+
+    // 打开方：等创建方初始化完成再使用
+    if(header_->ready.load(std::memory_order_acquire) != 1 || header_->magic != SHM_MAGIC
+        || size_ < sizeof(Header) + 2 * ShmRing::bytes(header_->capacity))
+    {
+        munmap(addr_, size_);
+        addr_ = nullptr;
+        header_ = nullptr;
+        return;
+    }
+    capacity = header_->capacity;
+    requestRing_ = std::make_unique<ShmRing>(base, capacity);
+    replyRing_ = std::make_unique<ShmRing>(base + ShmRing::bytes(capacity), capacity);
+}
+
+ShmRegion::~ShmRegion()
+{
+    if(addr_ != nullptr)
+        munmap(addr_, size_);
+    if(owner_ && addr_ != nullptr)
+        shm_unlink(name_.c_str());
+}
+
+bool ShmRegion::isValid() const
+{
+    return addr_ != nullptr;
+}
+
+ShmRing& ShmRegion::requestRing()
+{
+    return *requestRing_;
+}
+
+ShmRing& ShmRegion::replyRing()
+{
+    return *replyRing_;
+}
+
+void ShmRegion::close()
+{
+    header_->closed.store(1, std::memory_order_release);
+}
+
+bool ShmRegion::isClosed() const
+{
+    return header_->closed.load(std::memory_order_acquire) != 0;
+}
+
+////////////////  ShmTaskClient方法实现
+// 返回一个已经完成的future
+static std::future<ShmReply> readyReply(int status)
+{
+    std::promise<ShmReply> p;
+    p.set_value(ShmReply{status, std::string()});
+    return p.get_future();
+}
+
+ShmTaskClient::ShmTaskClient(const std::string& name, uint32_t capacity)
+    : region_(name, capacity, true)
+    , running_(false)
+    , nextReqId_(1)
+{
+    if(region_.isValid())
+    {
+        running_ = true;
+        reaper_ = std::thread(&ShmTaskClient::reapReplies, this);
+    }
+}
+
+ShmTaskClient::~ShmTaskClient()
+{
+    if(!region_.isValid())
+        return;
+    region_.close();
+    running_ = false;
+    reaper_.join();
+
+    std::lock_guard<std::mutex> lock(pendingMtx_);
+    for(auto& kv : pending_)
+    {
+        kv.second.set_value(ShmReply{SHM_STATUS_CLOSED, std::string()});
+    }
+    pending_.clear();
+}
+
+bool ShmTaskClient::isValid() const
+{
+    return region_.isValid();
+}
+
+std::future<ShmReply> ShmTaskClient::offload(uint32_t funcId, const void* data, size_t len)
+{
+    if(!region_.isValid())
+        return readyReply(SHM_STATUS_CLOSED);
+    if(len > SHM_TASK_PAYLOAD_SIZE)
+        return readyReply(SHM_STATUS_TOO_LARGE);
+
+    ShmTaskDesc desc;
+    desc.reqId = nextReqId_++;
+    desc.funcId = funcId;
+    desc.status = SHM_STATUS_OK;
+    desc.len = (uint32_t)len;
+    desc.reserved = 0;
+    memcpy(desc.payload, data, len);
+
+    std::future<ShmReply> result;
+    {
+        // 先登记再入环，避免回复比登记先到
+        std::lock_guard<std::mutex> lock(pendingMtx_);
+        result = pending_[desc.reqId].get_future();
+    }
+    if(!region_.requestRing().tryPush(desc))
+    {
+        std::lock_guard<std::mutex> lock(pendingMtx_);
+        pending_.erase(desc.reqId);
+        return readyReply(SHM_STATUS_FULL);
+    }
+    return result;
+}
+
+void ShmTaskClient::reapReplies()
+{
+    ShmTaskDesc desc;
+    int idle = 0;
+    while(running_)
+    {
+        if(!region_.replyRing().tryPop(desc))
+        {
+            backoff(idle);
+            continue;
+        }
+        idle = 0;
+
+        std::promise<ShmReply> p;
+        {
+            std::lock_guard<std::mutex> lock(pendingMtx_);
+            auto it = pending_.find(desc.reqId);
+            if(it == pending_.end())
+                continue;
+            p = std::move(it->second);
+            pending_.erase(it);
+        }
+        // 描述符由另一个进程写入，长度不可信
+        if(desc.len > SHM_TASK_PAYLOAD_SIZE)
+        {
+            p.set_value(ShmReply{SHM_STATUS_FAILED, std::string()});
+            continue;
+        }
+        p.set_value(ShmReply{desc.status, std::string(desc.payload, desc.len)});
+    }
+}
+
+////////////////  ShmTaskServer方法实现
+ShmTaskServer::ShmTaskServer(const std::string& name, ThreadPool& pool)
+    : region_(name, 0, false)
+    , pool_(pool)
+    , running_(false)
+    , inflight_(0)
+{}
+
+ShmTaskServer::~ShmTaskServer()
+{
+    stop();
+    // 等交给线程池的请求都写回结果
+    while(inflight_ > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool ShmTaskServer::isValid() const
+{
+    return region_.isValid();
+}
+
+void ShmTaskServer::registerHandler(uint32_t funcId, Handler handler)
+{
+    if(running_)
+        return;
+    handlers_[funcId] = std::move(handler);
+}
+
+void ShmTaskServer::start()
+{
+    if(!region_.isValid() || running_)
+        return;
+    running_ = true;
+    poller_ = std::thread(&ShmTaskServer::pollRequests, this);
+}
+
+void ShmTaskServer::wait()
+{
+    if(poller_.joinable())
+        poller_.join();
+}
+
+void ShmTaskServer::stop()
+{
+    running_ = false;
+    if(poller_.joinable())
+        poller_.join();
+}
+
+void ShmTaskServer::pollRequests()
+{
+    ShmTaskDesc req;
+    int idle = 0;
+    while(running_ && !region_.isClosed())
+    {
+        if(!region_.requestRing().tryPop(req))
+        {
+            backoff(idle);
+            continue;
+        }
+        idle = 0;
+
+        inflight_++;
+        // 线程池队列满时请求没有被执行，直接回复
+        if(!pool_.trySubmit([this, req](){ handle(req); }))
+        {
+            ShmTaskDesc resp;
+            resp.reqId = req.reqId;
+            resp.funcId = req.funcId;
+            resp.status = SHM_STATUS_FULL;
+            resp.len = 0;
+            resp.reserved = 0;
+            reply(resp);
+            inflight_--;
+        }
+    }
+}
+
+void ShmTaskServer::handle(const ShmTaskDesc& req)
+{
+    ShmTaskDesc resp;
+    resp.reqId = req.reqId;
+    resp.funcId = req.funcId;
+    resp.status = SHM_STATUS_OK;
+    resp.len = 0;
+    resp.reserved = 0;
+
+    auto it = handlers_.find(req.funcId);
+    if(req.len > SHM_TASK_PAYLOAD_SIZE)
+    {
+        // 描述符由另一个进程写入，长度不可信
+        resp.status = SHM_STATUS_TOO_LARGE;
+    }
+    else if(it == handlers_.end())
+    {
+        resp.status = SHM_STATUS_NO_HANDLER;
+    }
+    else
+    {
+        try
+        {
+            std::string out = it->second(std::string(req.payload, req.len));
+            if(out.size() > SHM_TASK_PAYLOAD_SIZE)
+            {
+                resp.status = SHM_STATUS_TOO_LARGE;
+            }
+            else
+            {
+                resp.len = (uint32_t)out.size();
+                memcpy(resp.payload, out.data(), out.size());
+            }
+        }
+        catch(...)
+        {
+            resp.status = SHM_STATUS_FAILED;
+        }
+    }
+    reply(resp);
+    inflight_--;
+}
+
+void ShmTaskServer::reply(const ShmTaskDesc& resp)
+{
+    // 回复环满时等待发起方收割，发起方已关闭则丢弃
+    int idle = 0;
+    while(!region_.replyRing().tryPush(resp))
+    {
+        if(region_.isClosed())
+            return;
+        backoff(idle);
+    }
+}
@@ -0,0 +1,180 @@
+#ifndef SHMOFFLOAD_H
+#define SHMOFFLOAD_H
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+#include "threadpool_2.h"
+
+// 同一台机器上多个进程之间转移任务：
+// 发起方(ShmTaskClient)创建具名共享内存，里面有请求环和回复环；
+// 接收方(ShmTaskServer)打开同名共享内存，按函数id调用注册的处理函数，在本进程的线程池里执行，结果写回回复环。
+// 可以有多个接收方同时从同一个请求环取任务，空闲的进程自然多取。
+
+const size_t SHM_TASK_PAYLOAD_SIZE = 232; // 描述符内联负载的大小，描述符整体256字节
+
+// 回复状态
+const int SHM_STATUS_OK = 0;
+const int SHM_STATUS_FULL = -1;        // 请求环或接收方线程池队列已满，调用方可以改为本地执行
+const int SHM_STATUS_TOO_LARGE = -2;   // 负载超过SHM_TASK_PAYLOAD_SIZE
+const int SHM_STATUS_NO_HANDLER = -3;  // 接收方没有注册该函数id
+const int SHM_STATUS_FAILED = -4;      // 处理函数抛出异常
+const int SHM_STATUS_CLOSED = -5;      // 发起方已关闭
+
+// 共享内存中的定长任务描述符，请求和回复共用
+struct ShmTaskDesc
+{
+    uint64_t reqId;
+    uint32_t funcId;
+    int32_t status;
+    uint32_t len;
+    uint32_t reserved;
+    char payload[SHM_TASK_PAYLOAD_SIZE];
+};
+
+// 放在共享内存里的无锁MPMC环形队列（每个槽位带序号），只使用地址无关的无锁原子操作
+class ShmRing
+{
+public:
+    // 环形队列占用的字节数，capacity必须是2的幂
+    static size_t bytes(uint32_t capacity);
+
+    // base指向共享内存中本队列的起始位置
+    ShmRing(void* base, uint32_t capacity);
+
+    // 由创建方调用一次，初始化队列
+    void init();
+
+    bool tryPush(const ShmTaskDesc& desc);
+    bool tryPop(ShmTaskDesc& desc);
+
+private:
+    struct Header
+    {
+        alignas(64) std::atomic<uint64_t> enqueuePos;
+        alignas(64) std::atomic<uint64_t> dequeuePos;
+    };
+    struct Cell
+    {
+        std::atomic<uint64_t> seq;
+        ShmTaskDesc desc;
+    };
+
+    Header* header_;
+    Cell* cells_;
+    uint64_t mask_;
+};
+
+// 一次远程执行的结果
+struct ShmReply
+{
+    int status;
+    std::string data;
+};
+
+// 映射到本进程的共享内存区域
+class ShmRegion
+{
+public:
+    // create为true时创建（已存在则先删除），否则打开已存在的区域
+    ShmRegion(const std::string& name, uint32_t capacity, bool create);
+    ~ShmRegion();
+
+    ShmRegion(const ShmRegion&) = delete;
+    ShmRegion& operator=(const ShmRegion&) = delete;
+
+    bool isValid() const;
+    ShmRing& requestRing();
+    ShmRing& replyRing();
+
+    // 发起方关闭后接收方停止取任务
+    void close();
+    bool isClosed() const;
+
+private:
+    struct Header;
+
+    std::string name_;
+    bool owner_;
+    void* addr_;
+    size_t size_;
+    Header* header_;
+    std::unique_ptr<ShmRing> requestRing_;
+    std::unique_ptr<ShmRing> replyRing_;
+};
+
+// 发起方
+class ShmTaskClient
+{
+public:
+    ShmTaskClient(const std::string& name, uint32_t capacity = 1024);
+    // 通知接收方关闭，未完成的请求以SHM_STATUS_CLOSED结束，并删除共享内存
+    ~ShmTaskClient();
+
+    ShmTaskClient(const ShmTaskClient&) = delete;
+    ShmTaskClient& operator=(const ShmTaskClient&) = delete;
+
+    bool isValid() const;
+
+    // 把任务交给其他进程执行，环满或负载过大时future立即返回对应的错误状态
+    std::future<ShmReply> offload(uint32_t funcId, const void* data, size_t len);
+
+private:
+    // 收割线程：从回复环取结果，完成对应的future
+    void reapReplies();
+
+    ShmRegion region_;
+    std::atomic_bool running_;
+    std::atomic<uint64_t> nextReqId_;
+    std::mutex pendingMtx_;
+    std::unordered_map<uint64_t, std::promise<ShmReply>> pending_;
+    std::thread reaper_;
+};
+
+// 接收方
+class ShmTaskServer
+{
+public:
+    // 处理函数：输入负载，返回结果（不能超过SHM_TASK_PAYLOAD_SIZE），抛异常表示失败
+    using Handler = std::function<std::string(const std::string& payload)>;
+
+    ShmTaskServer(const std::string& name, ThreadPool& pool);
+    ~ShmTaskServer();
+
+    ShmTaskServer(const ShmTaskServer&) = delete;
+    ShmTaskServer& operator=(const ShmTaskServer&) = delete;
+
+    bool isValid() const;
+
+    // 注册处理函数，需在start()之前调用
+    void registerHandler(uint32_t funcId, Handler handler);
+
+    // 启动轮询线程，把请求转交给线程池
+    void start();
+
+    // 等待发起方关闭
+    void wait();
+
+    void stop();
+
+private:
+    void pollRequests();
+    void handle(const ShmTaskDesc& req);
+    void reply(const ShmTaskDesc& resp);
+
+    ShmRegion region_;
+    ThreadPool& pool_;
+    std::unordered_map<uint32_t, Handler> handlers_;
+    std::atomic_bool running_;
+    std::atomic_int inflight_; // 已交给线程池但还没写回结果的请求数
+    std::thread poller_;
+};
+
+#endif
@@ -3,32 +3,78 @@
 #include <thread>
 #include <iostream>
 #include <future>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <unistd.h>
 
 const int TASK_MAX_THRESHHOLD = INT32_MAX;
 const int THREAD_MAX_THRESHHOLD = 1024;
 const int THREAD_MAX_IDLE_TIME = 60; // 单位：秒
+const int AFFINITY_STEAL_THRESHHOLD = 2000; // 单位：微秒
+
+// 当前线程的工作线程上下文
+static thread_local WorkerContext* currentWorker_ = nullptr;
+
+// 执行没有future承接的任务，异常只打印
+static void runGuarded(const std::function<void()>& task)
+{
+    try
+    {
+        task();
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "task threw exception: " << e.what() << std::endl;
+    }
+    catch(...)
+    {
+        std::cerr << "task threw unknown exception" << std::endl;
+    }
+}
 
 // 线程池构造
 ThreadPool::ThreadPool()
 	: initThreadSize_(0)
-	, taskSize_(0)
-	, idleThreadSize_(0)
+	, threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
 	, curThreadSize_(0)
+	, idleThreadSize_(0)
+	, localTaskSize_(0)
+	, affinityStealThreshold_(AFFINITY_STEAL_THRESHHOLD)
+	, affinitySubmitted_(0)
+	, affinityHits_(0)
+	, affinityStolen_(0)
+	, taskSize_(0)
 	, taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD)
-	, threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
 	, poolMode_(PoolMode::MODE_FIXED)
 	, isPoolRunning_(false)
+	, threadStackSize_(0)
+	, threadGuardSize_(0)
+	, poolId_(generatePoolId_++)
 
-{}
+{
+    tenants_[DEFAULT_TENANT];
+}
+
+std::atomic_int ThreadPool::generatePoolId_(0);
 
 ThreadPool::~ThreadPool()
 {
-    isPoolRunning_ = false;
-
-    std::unique_lock<std::mutex> lock(taskQueMtx_);
-    notEmpty_.notify_all();
-    exitCond_.wait(lock, [&]()->bool{return taskSize_ == 0;});
+    std::unordered_map<int, std::unique_ptr<Thread>> threads;
+    {
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        isPoolRunning_ = false;
+        notEmpty_.notify_all();
+        // 取走线程对象，之后退休的线程不会再从map中删除自己
+        threads.swap(threads_);
+    }
 
+    // 工作线程执行完队列中剩余的任务后退出，逐个回收
+    for(auto& kv : threads)
+    {
+        kv.second->join();
+    }
 }
 
 // 设置线程池的工作模式
@@ -52,31 +98,261 @@ void ThreadPool::setThreadSizeThreshHold(int threshhold){
     threadSizeThreshHold_ = threshhold;
 }
 
+// 设置工作线程栈大小
+void ThreadPool::setThreadStackSize(size_t size){
+    if(checkRunningState())
+        return;
+    threadStackSize_ = size;
+}
+
+// 设置工作线程栈保护区大小
+void ThreadPool::setThreadGuardSize(size_t size){
+    if(checkRunningState())
+        return;
+    threadGuardSize_ = size;
+}
+
+// 设置亲和任务可被其他线程取走的阈值
+void ThreadPool::setAffinityStealThreshold(int us){
+    if(checkRunningState())
+        return;
+    affinityStealThreshold_ = std::chrono::microseconds(us);
+}
+
+AffinityStats ThreadPool::getAffinityStats()
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    return AffinityStats{affinitySubmitted_, affinityHits_, affinityStolen_, localTaskSize_};
+}
+
+// 设置工作线程启动回调
+void ThreadPool::onWorkerStart(WorkerHook hook){
+    if(checkRunningState())
+        return;
+    workerStartHook_ = std::move(hook);
+}
+
+// 设置工作线程退出回调
+void ThreadPool::onWorkerStop(WorkerHook hook){
+    if(checkRunningState())
+        return;
+    workerStopHook_ = std::move(hook);
+}
+
+WorkerContext* ThreadPool::currentWorker()
+{
+    return currentWorker_;
+}
+
+// 添加或修改租户
+void ThreadPool::addTenant(int id, int weight, size_t queueLimit)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    TenantQueue& tq = tenants_[id];
+    tq.weight = weight > 0 ? weight : 1;
+    tq.queueLimit = queueLimit;
+    notFull_.notify_all();
+}
+
+bool ThreadPool::removeTenant(int id)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    auto it = tenants_.find(id);
+    if(id == DEFAULT_TENANT || it == tenants_.end() || it->second.active || it->second.waiting > 0)
+        return false;
+    tenants_.erase(it);
+    // 其他租户的份额变大
+    notFull_.notify_all();
+    return true;
+}
+
+TenantStats ThreadPool::getTenantStats(int id)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    TenantStats stats{0, 0, 0, 0, 0, 0};
+    auto it = tenants_.find(id);
+    if(it != tenants_.end())
+    {
+        const TenantQueue& tq = it->second;
+        stats.weight = tq.weight;
+        stats.queueLimit = tq.queueLimit;
+        stats.queued = tq.tasks.size();
+        stats.submitted = tq.submitted;
+        stats.rejected = tq.rejected;
+        stats.dispatched = tq.dispatched;
+    }
+    return stats;
+}
 
-void ThreadPool::start(int initThreadSize)
+bool ThreadPool::enqueueTask(std::function<void()> task, int tenantId)
 {
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    // unordered_map的元素地址在插入时不变，activeTenants_可以直接保存指针
+    TenantQueue& tq = tenants_[tenantId];
+    tq.waiting++;
+    bool ready = notFull_.wait_for(lock, std::chrono::seconds(1), [&]()->bool
+    {
+        return taskSize_ < taskQueMaxThreshHold_ && tq.tasks.size() < std::min(tq.queueLimit, tenantShare(tenantId));
+    });
+    tq.waiting--;
+    if(!ready)
+    {
+        // 表示notFull_等待1s，条件依然没有满足
+        std::cerr << "task queue is full, submit task fail." << std::endl;
+        tq.rejected++;
+        return false;
+    }
+
+    pushTenantTask(std::move(task), tenantId);
+    notEmpty_.notify_all();
+
+    addThreadIfNeeded();
+    return true;
+}
+
+bool ThreadPool::enqueueTask(std::function<void()> task, Affinity affinity)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    if(!notFull_.wait_for(lock, std::chrono::seconds(1), [&]()->bool{return taskSize_ < taskQueMaxThreshHold_;}))
+    {
+        std::cerr << "task queue is full, submit task fail." << std::endl;
+        return false;
+    }
+
+    if(workerOrder_.empty())
+    {
+        // 还没有工作线程，放入默认租户的队列
+        pushTenantTask(std::move(task), DEFAULT_TENANT);
+    }
+    else
+    {
+        localQueues_[pickWorker(affinity)].tasks.emplace_back(std::chrono::steady_clock::now(), std::move(task));
+        localTaskSize_++;
+        affinitySubmitted_++;
+        taskSize_++;
+    }
+
+    // 指定的线程可能在等待，只能全部唤醒
+    notEmpty_.notify_all();
+
+    addThreadIfNeeded();
+    return true;
+}
+
+void ThreadPool::pushTenantTask(std::function<void()> task, int tenantId)
+{
+    TenantQueue& tq = tenants_[tenantId];
+    tq.tasks.emplace(std::move(task));
+    tq.submitted++;
+    taskSize_++;
+    if(!tq.active)
+    {
+        tq.active = true;
+        // 成为唯一有任务的租户时直接轮到它
+        if(activeTenants_.empty())
+            tq.deficit = tq.weight;
+        activeTenants_.push_back(&tq);
+    }
+}
+
+size_t ThreadPool::tenantShare(int tenantId) const
+{
+    int totalWeight = 0;
+    for(auto& kv : tenants_)
+    {
+        const TenantQueue& tq = kv.second;
+        // 空闲的默认租户不占份额，不用租户的程序不受影响
+        if(kv.first == DEFAULT_TENANT && kv.first != tenantId && !tq.active && tq.waiting == 0)
+            continue;
+        totalWeight += tq.weight;
+    }
+    size_t share = taskQueMaxThreshHold_ * tenants_.at(tenantId).weight / totalWeight;
+    return std::max<size_t>(share, 1);
+}
+
+int ThreadPool::pickWorker(Affinity affinity) const
+{
+    size_t n = workerOrder_.size();
+    size_t index;
+    if(affinity.byIndex)
+        index = affinity.value % n;
+    else
+        index = ((affinity.value * 0x9E3779B97F4A7C15ULL) >> 32) % n; // 打散相邻的key
+    return workerOrder_[index];
+}
+
+bool ThreadPool::addThread()
+{
+    std::unique_ptr<Thread> ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+    int threadId = ptr->getId();
+    std::string name = "pool-" + std::to_string(poolId_) + "-w" + std::to_string(threadId);
+    if(!ptr->start(threadStackSize_, threadGuardSize_, name))
+    {
+        return false;
+    }
+    threads_.emplace(threadId, std::move(ptr));
+    localQueues_[threadId];
+    workerOrder_.push_back(threadId);
+    // 修改线程个数相关的变量
+    curThreadSize_++;
+    idleThreadSize_++;
+    return true;
+}
+
+bool ThreadPool::trySubmit(std::function<void()> task)
+{
+    return enqueueTask([task](){ runGuarded(task); }, DEFAULT_TENANT);
+}
+
+void ThreadPool::submitOrRun(std::function<void()> task)
+{
+    if(!trySubmit(task))
+        runGuarded(task);
+}
+
+void ThreadPool::addThreadIfNeeded()
+{
+    // 亲和任务只能由指定的线程或偷取执行，新线程帮不上忙
+    if(poolMode_ == PoolMode::MODE_CACHED && taskSize_ - localTaskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_)
+    {
+        std::cout << ">>> create new thread..." << std::endl;
+        addThread();
+    }
+}
+
+bool ThreadPool::start(int initThreadSize)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+
     // 设置线程池的运行状态
 	isPoolRunning_ = true;
 
-	// 记录初始线程个数
-	initThreadSize_ = initThreadSize;
-	curThreadSize_ = initThreadSize;
-
+    int started = 0;
     for(int i = 0; i < initThreadSize; i ++){
-        std::unique_ptr<Thread> ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-        int threadId = ptr->getId();
-        threads_.emplace(threadId, std::move(ptr));
+        if(addThread())
+            started++;
     }
 
-    for(int i = 0; i < initThreadSize; i ++){
-        threads_[i]->start();
-        idleThreadSize_++;
+	// 记录初始线程个数，cached模式下只回收超出的线程
+	initThreadSize_ = started;
+    if(started < initThreadSize)
+    {
+        std::cerr << "start thread pool: only " << started << " of " << initThreadSize << " threads started" << std::endl;
+        return false;
     }
+    return true;
 }
 void ThreadPool::threadFunc(int threadId)
 {
     auto lastTime = std::chrono::high_resolution_clock().now();
 
+    WorkerContext context(this, threadId);
+    currentWorker_ = &context;
+    if(workerStartHook_)
+        workerStartHook_(threadId);
+
+    bool exiting = false;
+    bool retired = false; // cached模式下空闲退休
     for(;;)
     {
         std::function<void()> t;
@@ -86,51 +362,59 @@ void ThreadPool::threadFunc(int threadId)
             std::cout << "tid:" << std::this_thread::get_id()
 				<< "尝试获取任务..." << std::endl;
 
-            while(taskSize_ == 0)
+            localQueues_[threadId].busy = false;
+            auto stealAt = std::chrono::steady_clock::time_point::max();
+            while(!(t = takeTaskFor(threadId, stealAt)))
             {
                 // 回收线程资源
-                if (!isPoolRunning_)
+                if (!isPoolRunning_ && taskSize_ == 0)
                 {
-                    threads_.erase(threadId); // std::this_thread::getid()
+                    // 线程对象由析构函数join回收
                     std::cout << "threadid:" << std::this_thread::get_id() << " exit!"
                         << std::endl;
-                    exitCond_.notify_all();
-                    return; // 线程函数结束，线程结束
+                    exiting = true;
+                    break;
                 }
                 if(poolMode_ == PoolMode::MODE_CACHED)
                 {
+                    // 其他线程积压的本地任务到时间可以取时也要醒来
+                    auto waitUntil = std::min(stealAt, std::chrono::steady_clock::now() + std::chrono::seconds(1));
                     if(std::cv_status::timeout ==
-						notEmpty_.wait_for(lock, std::chrono::seconds(1)))
+						notEmpty_.wait_until(lock, waitUntil))
                         {
                             auto now = std::chrono::high_resolution_clock().now();
 						    auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
                             if(dur.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ >initThreadSize_)
                             {
-                                threads_.erase(threadId);
                                 curThreadSize_--;
 							    idleThreadSize_--;
 
                                 std::cout << "threadid:" << std::this_thread::get_id() << " exit!"
                                     << std::endl;
-                                return;
+                                exiting = true;
+                                retired = true;
+                                break;
 
                             }
                         }
                 }
-                else
+                else if(stealAt == std::chrono::steady_clock::time_point::max())
                 {
                     notEmpty_.wait(lock);
                 }
-                // if(!isPoolRunning_)
-                // {
-                //     threads_.erase(threadId);
-                //     exitCond_.notify_all();
-                //     return;
-                // }
-                if(!isPoolRunning_)
+                else
                 {
-                    break;
+                    notEmpty_.wait_until(lock, stealAt);
                 }
+                // 被唤醒后回到循环开头：没有可取的任务且线程池已停止时在上面回收线程，
+                // 不能直接break去取空队列
+            }
+            if(exiting)
+            {
+                // 自己的本地队列一定是空的，之后的亲和任务不再分给本线程
+                localQueues_.erase(threadId);
+                workerOrder_.erase(std::find(workerOrder_.begin(), workerOrder_.end(), threadId));
+                break;
             }
  
 
@@ -139,11 +423,11 @@ void ThreadPool::threadFunc(int threadId)
             idleThreadSize_--;
             std::cout << "tid:" << std::this_thread::get_id()
 				<< "获取任务成功..." << std::endl;
-            t = taskQue_.front();
-            taskQue_.pop();
             taskSize_--;
 
-            if(taskQue_.size() > 0)
+            // 还有任务时唤醒其他线程；线程池停止时最后一个任务被取走也要唤醒，
+            // 等着其他线程本地任务的线程没有超时，否则不会醒来退出
+            if(taskSize_ > 0 || !isPoolRunning_)
             {
                 notEmpty_.notify_all();
             }
@@ -161,6 +445,92 @@ void ThreadPool::threadFunc(int threadId)
         lastTime = std::chrono::high_resolution_clock().now();
 
     }
+
+    // 在锁外执行退出回调并销毁本线程的WorkerLocal值
+    if(workerStopHook_)
+        workerStopHook_(threadId);
+    context.releaseSlots();
+    currentWorker_ = nullptr;
+
+    if(retired)
+    {
+        // 退休的线程最后才从map中删除自己（线程对象析构时分离）；
+        // 期间线程池开始析构的话，线程对象已被析构函数取走，由它join
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        threads_.erase(threadId);
+    }
+}
+
+std::function<void()> ThreadPool::takeTask()
+{
+    for(;;)
+    {
+        TenantQueue* tq = activeTenants_.front();
+        if(tq->deficit > 0)
+        {
+            std::function<void()> task = std::move(tq->tasks.front());
+            tq->tasks.pop();
+            tq->deficit--;
+            tq->dispatched++;
+            if(tq->tasks.empty())
+            {
+                // 队列取空的租户退出本轮，不保留剩余额度
+                tq->active = false;
+                tq->deficit = 0;
+                activeTenants_.pop_front();
+                if(!activeTenants_.empty())
+                    activeTenants_.front()->deficit += activeTenants_.front()->weight;
+            }
+            return task;
+        }
+        // 本轮额度用完，轮到下一个租户，新一轮按权重补充额度
+        activeTenants_.pop_front();
+        activeTenants_.push_back(tq);
+        activeTenants_.front()->deficit += activeTenants_.front()->weight;
+    }
+}
+
+std::function<void()> ThreadPool::takeTaskFor(int threadId, std::chrono::steady_clock::time_point& stealAt)
+{
+    stealAt = std::chrono::steady_clock::time_point::max();
+    LocalQueue& own = localQueues_[threadId];
+    std::function<void()> task;
+    if(!own.tasks.empty())
+    {
+        task = std::move(own.tasks.front().second);
+        own.tasks.pop_front();
+        localTaskSize_--;
+        affinityHits_++;
+    }
+    else if(!activeTenants_.empty())
+    {
+        task = takeTask();
+    }
+    else if(localTaskSize_ > 0)
+    {
+        // 只取忙碌线程队头等待太久的任务，空闲的线程会自己来取
+        auto now = std::chrono::steady_clock::now();
+        for(auto& kv : localQueues_)
+        {
+            LocalQueue& lq = kv.second;
+            if(kv.first == threadId || lq.tasks.empty() || !lq.busy)
+                continue;
+            auto at = lq.tasks.front().first + affinityStealThreshold_;
+            if(at <= now)
+            {
+                task = std::move(lq.tasks.front().second);
+                lq.tasks.pop_front();
+                localTaskSize_--;
+                affinityStolen_++;
+                break;
+            }
+            stealAt = std::min(stealAt, at);
+        }
+    }
+
+    if(task)
+        own.busy = true;
+    return task;
 }
 
 bool ThreadPool::checkRunningState() const
@@ -168,23 +538,144 @@ bool ThreadPool::checkRunningState() const
 	return isPoolRunning_;
 }
 
+//////////////// 工作线程上下文
+WorkerContext::WorkerContext(ThreadPool* pool, int workerId)
+    : pool_(pool)
+    , workerId_(workerId)
+{}
+
+ThreadPool* WorkerContext::pool() const
+{
+    return pool_;
+}
+
+int WorkerContext::workerId() const
+{
+    return workerId_;
+}
+
+void* WorkerContext::getSlot(uint64_t key) const
+{
+    auto it = slots_.find(key);
+    if(it == slots_.end() || it->second.owner.expired())
+        return nullptr;
+    return it->second.value;
+}
+
+void WorkerContext::setSlot(uint64_t key, void* value, std::weak_ptr<void> owner, std::function<void()> release)
+{
+    // 清理已销毁的WorkerLocal留下的槽，固定线程数的线程池里工作线程不退出，不清理会一直增长
+    for(auto it = slots_.begin(); it != slots_.end();)
+    {
+        if(it->second.owner.expired())
+            it = slots_.erase(it);
+        else
+            ++it;
+    }
+    slots_[key] = Slot{value, std::move(owner), std::move(release)};
+}
+
+uint64_t WorkerContext::generateSlotKey()
+{
+    static std::atomic<uint64_t> nextKey(1);
+    return nextKey++;
+}
+
+void WorkerContext::releaseSlots()
+{
+    // release里可能再次用到上下文，先取出来
+    std::map<uint64_t, Slot> slots;
+    slots.swap(slots_);
+    for(auto it = slots.rbegin(); it != slots.rend(); ++it)
+    {
+        if(it->second.release && !it->second.owner.expired())
+            it->second.release();
+    }
+}
+
 ////////////////  线程方法实现
-int Thread::generateId_ = 0;
+std::atomic_int Thread::generateId_(0);
+
+// 传给新线程的启动参数，线程对象可能先于线程结束被销毁，所以单独拷贝一份
+struct ThreadStartArg
+{
+    Thread::ThreadFunc func;
+    int threadId;
+    std::string name;
+};
 
 // 线程构造
 Thread::Thread(ThreadFunc func)
 	: func_(func)
     , threadId_(generateId_++)
+    , handle_()
+    , joinable_(false)
 {}
 
 // 线程析构
-Thread::~Thread() {}
+Thread::~Thread()
+{
+    // cached模式下空闲退出的线程在自己的线程里删除线程对象，此时分离即可
+    if(joinable_)
+    {
+        pthread_detach(handle_);
+    }
+}
+
+bool Thread::start(size_t stackSize, size_t guardSize, const std::string& name)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if(stackSize > 0)
+    {
+        // 栈大小不能小于PTHREAD_STACK_MIN，并按页对齐
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        stackSize = std::max(stackSize, (size_t)PTHREAD_STACK_MIN);
+        stackSize = (stackSize + page - 1) / page * page;
+        pthread_attr_setstacksize(&attr, stackSize);
+    }
+    if(guardSize > 0)
+    {
+        pthread_attr_setguardsize(&attr, guardSize);
+    }
+
+    ThreadStartArg* arg = new ThreadStartArg{func_, threadId_, name};
+    int err = pthread_create(&handle_, &attr, &Thread::threadEntry, arg);
+    pthread_attr_destroy(&attr);
+    if(err != 0)
+    {
+        delete arg;
+        std::cerr << "create thread fail: " << strerror(err) << std::endl;
+        return false;
+    }
+    joinable_ = true;
+    return true;
+}
+
+void* Thread::threadEntry(void* arg)
+{
+    std::unique_ptr<ThreadStartArg> startArg(static_cast<ThreadStartArg*>(arg));
+    if(!startArg->name.empty())
+    {
+        // 线程名最长15个字符
+        pthread_setname_np(pthread_self(), startArg->name.substr(0, 15).c_str());
+    }
+    startArg->func(startArg->threadId);
+    return nullptr;
+}
+
+void Thread::join()
+{
+    if(joinable_)
+    {
+        pthread_join(handle_, nullptr);
+        joinable_ = false;
+    }
+}
 
-void Thread::start()
+pthread_t Thread::nativeHandle() const
 {
-    // 创建一个线程来执行一个线程函数 pthread_create
-	std::thread t(func_, threadId_);  // C++11来说 线程对象t  和线程函数func_
-	t.detach(); // 设置分离线程   pthread_detach  pthread_t设置成分离线程
+    return handle_;
 }
 
 int Thread::getId() const
@@ -9,8 +9,17 @@
 #include <condition_variable>
 #include <functional>
 #include <unordered_map>
+#include <map>
+#include <deque>
+#include <cstdint>
 #include <future>
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <pthread.h>
+
+#include "cancellation.h"
+
 class Semaphore
 {
 public:
@@ -44,23 +53,125 @@ enum class PoolMode
 	MODE_CACHED, // 线程数量可动态增长
 };
 
+// 租户：共享同一个线程池的不同业务，各自有子队列，按权重公平调度
+struct Tenant
+{
+    int id;
+};
+
+// 未指定租户的任务属于默认租户
+const int DEFAULT_TENANT = 0;
+
+// 租户的统计信息
+struct TenantStats
+{
+    int weight;          // 权重
+    size_t queueLimit;   // 子队列上限
+    size_t queued;       // 当前排队的任务数
+    uint64_t submitted;  // 入队成功的任务数
+    uint64_t rejected;   // 队列满被拒绝的任务数
+    uint64_t dispatched; // 已被工作线程取走的任务数
+};
+
+// 亲和提示：访问同一个对象的任务尽量交给同一个工作线程，让它的缓存保持热
+// 只是尽力而为，不保证顺序；指定的线程忙得太久时任务会被其他线程取走
+struct Affinity
+{
+    uint64_t value;
+    bool byIndex; // true表示value是工作线程序号（按创建顺序，对线程数取模），false表示value是key
+
+    static Affinity key(uint64_t k)
+    {
+        return Affinity{k, false};
+    }
+
+    static Affinity worker(size_t index)
+    {
+        return Affinity{index, true};
+    }
+};
+
+// 亲和提交的统计信息
+struct AffinityStats
+{
+    uint64_t submitted; // 带亲和提示入队的任务数
+    uint64_t localHits; // 由指定的工作线程执行的任务数
+    uint64_t stolen;    // 被其他工作线程取走的任务数
+    size_t queued;      // 当前在各线程本地队列中排队的任务数
+};
+
+class ThreadPool;
+
+// 工作线程的回调，参数为线程id
+using WorkerHook = std::function<void(int)>;
+
+// 工作线程上下文，任务里通过ThreadPool::currentWorker()取得
+class WorkerContext
+{
+public:
+    WorkerContext(ThreadPool* pool, int workerId);
+    ~WorkerContext() = default;
+
+    WorkerContext(const WorkerContext&) = delete;
+    WorkerContext& operator=(const WorkerContext&) = delete;
+
+    // 所属线程池
+    ThreadPool* pool() const;
+
+    // 工作线程id
+    int workerId() const;
+
+    // 本线程上按key保存的值，不存在或owner已销毁时返回nullptr，供WorkerLocal使用
+    void* getSlot(uint64_t key) const;
+
+    // 保存一个值，owner销毁后槽失效并在下次setSlot时清理；release在线程退出时调用
+    void setSlot(uint64_t key, void* value, std::weak_ptr<void> owner, std::function<void()> release);
+
+    // 线程退出时按保存的逆序调用仍有效的槽的release
+    void releaseSlots();
+
+    // 生成全局唯一的key，不复用，销毁的WorkerLocal在线程上残留的槽不会被误认
+    static uint64_t generateSlotKey();
+private:
+    ThreadPool* pool_;
+    int workerId_;
+    struct Slot
+    {
+        void* value;
+        std::weak_ptr<void> owner;
+        std::function<void()> release;
+    };
+    std::map<uint64_t, Slot> slots_; // key递增，按key逆序即创建的逆序
+};
+
 class Thread{
 public:
     using ThreadFunc = std::function<void(int)>;
 
 	// 线程构造
 	Thread(ThreadFunc func);
-	// 线程析构
+	// 线程析构，没有join的线程在这里分离
 	~Thread();
     
-    void start();
+    // 按属性创建线程，stackSize/guardSize为0时使用系统默认值，name最长15个字符
+    bool start(size_t stackSize = 0, size_t guardSize = 0, const std::string& name = "");
+
+    // 等待线程结束
+    void join();
 
     	// 获取线程id
 	int getId()const;
+
+    // 获取线程句柄
+    pthread_t nativeHandle() const;
 private:
+    static void* threadEntry(void* arg);
+
     ThreadFunc func_;
-    static int generateId_;
+    static std::atomic_int generateId_;
 	int threadId_;  // 保存线程id
+    pthread_t handle_; // 线程句柄
+    bool joinable_; // 线程已创建且尚未join/分离
 };
 
 class ThreadPool
@@ -81,49 +192,124 @@ public:
 	// 设置线程池cached模式下线程阈值
 	void setThreadSizeThreshHold(int threshhold);
 
+    // 设置工作线程栈大小（字节），0表示系统默认（通常8MB）
+    void setThreadStackSize(size_t size);
+
+    // 设置工作线程栈保护区大小（字节），0表示系统默认
+    void setThreadGuardSize(size_t size);
+
+    // 添加租户或修改已有租户的权重和子队列上限，运行中也可以调用
+    // 繁忙时各租户按权重比例分得线程，其他租户空闲时一个租户也能用满整个线程池
+    // 排队的任务数不超过queueLimit，也不超过任务队列上限按权重分给它的份额，一个租户占不满其他租户的位置；
+    // 默认租户只在有任务时参与分配
+    // submitTask(Tenant{id}, ...)遇到不存在的租户时按默认参数自动添加，条目一直保留到removeTenant
+    void addTenant(int id, int weight = 1, size_t queueLimit = SIZE_MAX);
+
+    // 删除租户，它的份额分给其他租户；还有排队的任务、有提交者在等待或是默认租户时返回false
+    bool removeTenant(int id);
+
+    // 获取租户的统计信息，租户不存在时各项为0
+    TenantStats getTenantStats(int id);
+
+    // 设置亲和任务可被其他线程取走的阈值（微秒）：指定的线程正忙，且本地队列里最早的任务已等待超过这么久时，
+    // 其他线程从队头取走；指定的线程连续执行很多短任务而积压时也会被分担
+    void setAffinityStealThreshold(int us);
+
+    // 获取亲和提交的统计信息
+    AffinityStats getAffinityStats();
+
+    // 工作线程开始取任务前在该线程上调用，start之前设置
+    void onWorkerStart(WorkerHook hook);
+
+    // 工作线程退出（cached模式空闲退休或线程池析构）时在该线程上调用，不持有线程池的锁，start之前设置
+    void onWorkerStop(WorkerHook hook);
+
+    // 当前线程的工作线程上下文，不是线程池的工作线程时返回nullptr
+    static WorkerContext* currentWorker();
+
 	// 给线程池提交任务
     template<typename Func, typename... Args>
 	auto submitTask(Func&& func, Args&&... args)->std::future<decltype(func(args...))>
     {
-    
+        return submitTask(Tenant{DEFAULT_TENANT}, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    // 以指定租户的身份提交任务，未添加过的租户按权重1自动创建
+    template<typename Func, typename... Args>
+    auto submitTask(Tenant tenant, Func&& func, Args&&... args)->std::future<decltype(func(args...))>
+    {
         using returnType = decltype(func(args...));
         auto taskResult = std::make_shared<std::packaged_task<returnType()>>(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
         std::future<returnType> result = taskResult->get_future();
 
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
-        if(!notFull_.wait_for(lock, std::chrono::seconds(1), [&]()->bool{return taskQue_.size() < taskQueMaxThreshHold_;}))
+        if(!enqueueTask([taskResult](){(*taskResult)();}, tenant.id))
         {
-            // 表示notFull_等待1s，条件依然没有满足
-            std::cerr << "task queue is full, submit task fail." << std::endl;
-            // return task->getResult();  // Task  Result   线程执行完task，task对象就被析构掉了
+            // 提交失败，返回一个默认值
             auto taskResult = std::make_shared<std::packaged_task<returnType()>>([]()->returnType{return returnType();});
             (*taskResult)();
             return taskResult->get_future();
         }
+        return result;
+    }
 
-        taskQue_.emplace([taskResult](){(*taskResult)();});
-        taskSize_++;
-        
+    // 提交可取消的任务：token被取消后，还在队列里的任务不再执行，future以TaskCancelled异常结束
+    // 已取消的任务在被工作线程取出跳过之前仍占用任务队列上限和租户的子队列上限
+    template<typename Func, typename... Args>
+    auto submitTask(CancellationToken token, Func&& func, Args&&... args)->std::future<decltype(func(args...))>
+    {
+        return submitTask(Tenant{DEFAULT_TENANT}, std::move(token), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
 
-        notEmpty_.notify_all();
+    // 以指定租户的身份提交可取消的任务
+    template<typename Func, typename... Args>
+    auto submitTask(Tenant tenant, CancellationToken token, Func&& func, Args&&... args)->std::future<decltype(func(args...))>
+    {
+        using returnType = decltype(func(args...));
+        auto bound = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+        auto task = std::make_shared<CancellableTask<returnType, decltype(bound)>>(std::move(bound), std::move(token));
+        std::future<returnType> result = task->getFuture();
 
-        if(poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_)
+        task->attach();
+        if(task->isCancelled())
         {
-            std::cout << ">>> create new thread..." << std::endl;
+            return result; // 已经取消的不再入队
+        }
+        if(!enqueueTask([task](){task->run();}, tenant.id))
+        {
+            // 提交失败，从令牌上注销，同样以取消状态结束
+            task->reject();
+        }
+        return result;
+    }
 
-            std::unique_ptr<Thread> ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-            int threadId = ptr->getId();
-            threads_.emplace(threadId, std::move(ptr));
-            threads_[threadId]->start();
-            // 修改线程个数相关的变量
-            curThreadSize_++;
-            idleThreadSize_++;
+    // 带亲和提示提交任务：进入指定工作线程的本地队列，该线程优先执行
+    // 亲和任务不参与租户的公平调度；线程池还没有工作线程时放入默认租户的队列
+    template<typename Func, typename... Args>
+    auto submitTask(Affinity affinity, Func&& func, Args&&... args)->std::future<decltype(func(args...))>
+    {
+        using returnType = decltype(func(args...));
+        auto taskResult = std::make_shared<std::packaged_task<returnType()>>(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+        std::future<returnType> result = taskResult->get_future();
 
+        if(!enqueueTask([taskResult](){(*taskResult)();}, affinity))
+        {
+            // 提交失败，返回一个默认值
+            auto taskResult = std::make_shared<std::packaged_task<returnType()>>([]()->returnType{return returnType();});
+            (*taskResult)();
+            return taskResult->get_future();
         }
         return result;
     }
 
-    void start(int initThreadSize = 4);
+    // 提交不需要结果的任务，返回是否入队成功（队列满等待1s仍失败时为false）
+    // 任务抛出的异常被捕获并打印，不会传到工作线程之外
+    bool trySubmit(std::function<void()> task);
+
+    // 提交不需要结果的任务，被拒绝时在当前线程直接执行，异常处理同trySubmit
+    void submitOrRun(std::function<void()> task);
+
+    // 启动线程池，初始线程数按实际创建成功的个数记录；有线程创建失败时返回false
+    bool start(int initThreadSize = 4);
 
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
@@ -131,6 +317,34 @@ private:
 	// 定义线程函数
 	void threadFunc(int threadId);
 
+    // 任务入队到租户的子队列，队列满等待1s仍失败时返回false
+    bool enqueueTask(std::function<void()> task, int tenantId);
+
+    // 亲和任务入队到指定工作线程的本地队列，队列满等待1s仍失败时返回false
+    bool enqueueTask(std::function<void()> task, Affinity affinity);
+
+    // 放入租户的子队列，调用者需持有taskQueMtx_
+    void pushTenantTask(std::function<void()> task, int tenantId);
+
+    // 任务队列上限按权重分给该租户的份额，调用者需持有taskQueMtx_
+    size_t tenantShare(int tenantId) const;
+
+    // 按赤字轮转(DRR)从各租户子队列中取一个任务，调用者需持有taskQueMtx_且保证有任务
+    std::function<void()> takeTask();
+
+    // 给工作线程取一个任务：先取自己的本地队列，再取租户子队列，最后取其他线程忙太久而积压的本地任务
+    // 没有可取的任务时返回空，stealAt为最早可以去取其他线程本地任务的时间。调用者需持有taskQueMtx_
+    std::function<void()> takeTaskFor(int threadId, std::chrono::steady_clock::time_point& stealAt);
+
+    // 亲和提示对应的工作线程id，调用者需持有taskQueMtx_且保证有工作线程
+    int pickWorker(Affinity affinity) const;
+
+    // 创建并启动一个工作线程，调用者需持有taskQueMtx_
+    bool addThread();
+
+    // cached模式下任务比空闲线程多时增加线程，本地队列积压的亲和任务不计入，调用者需持有taskQueMtx_
+    void addThreadIfNeeded();
+
     bool checkRunningState() const;
 private:
     std::unordered_map<int ,std::unique_ptr<Thread>> threads_;
@@ -141,18 +355,54 @@ private:
 	std::atomic_int idleThreadSize_; // 记录空闲线程的数量
 
 
-    std::queue<std::function<void()>> taskQue_;
-    std::atomic_uint taskSize_;
+    // 租户的子队列
+    struct TenantQueue
+    {
+        int weight = 1;                   // 每轮可取的任务数
+        size_t queueLimit = SIZE_MAX;     // 子队列上限
+        int deficit = 0;                  // 本轮剩余可取的任务数
+        bool active = false;              // 是否在activeTenants_中
+        int waiting = 0;                  // 正在等待入队的提交者数
+        std::queue<std::function<void()>> tasks;
+        uint64_t submitted = 0;
+        uint64_t rejected = 0;
+        uint64_t dispatched = 0;
+    };
+    std::unordered_map<int, TenantQueue> tenants_;
+    std::deque<TenantQueue*> activeTenants_; // 有任务的租户，队首是当前轮到的租户
+
+    // 工作线程的本地队列，存放亲和任务及其入队时间
+    struct LocalQueue
+    {
+        std::deque<std::pair<std::chrono::steady_clock::time_point, std::function<void()>>> tasks;
+        bool busy = false; // 是否正在执行任务
+    };
+    std::unordered_map<int, LocalQueue> localQueues_; // 线程id -> 本地队列
+    std::vector<int> workerOrder_; // 按创建顺序排列的工作线程id，亲和提示据此选线程
+    size_t localTaskSize_;         // 所有本地队列排队的任务总数
+    std::chrono::microseconds affinityStealThreshold_;
+    uint64_t affinitySubmitted_;
+    uint64_t affinityHits_;
+    uint64_t affinityStolen_;
+
+    std::atomic_uint taskSize_;    // 所有租户和本地队列排队的任务总数
     size_t taskQueMaxThreshHold_;  // 任务队列数量上限阈值 
     
     std::mutex taskQueMtx_; // 保证任务队列的线程安全
 	std::condition_variable notFull_; // 表示任务队列不满
 	std::condition_variable notEmpty_; // 表示任务队列不空
-    std::condition_variable exitCond_;
 
     PoolMode poolMode_;
     std::atomic_bool isPoolRunning_;
 
+    size_t threadStackSize_; // 工作线程栈大小
+    size_t threadGuardSize_; // 工作线程栈保护区大小
+    int poolId_; // 线程池编号，用于线程命名 pool-<poolId>-w<threadId>
+    static std::atomic_int generatePoolId_;
+
+    WorkerHook workerStartHook_; // 工作线程启动回调
+    WorkerHook workerStopHook_;  // 工作线程退出回调
+
 
 
 };
@@ -0,0 +1,124 @@
+#ifndef WORKERLOCAL_H
+#define WORKERLOCAL_H
+
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <stdexcept>
+
+#include "threadpool_2.h"
+
+// 每个工作线程一份的值，第一次在某个工作线程上get()时创建，之后该线程上的任务复用
+// 适合大块的临时缓冲区、解析器、压缩上下文，以及按线程累加最后再合并的部分结果
+// 工作线程退出（cached模式空闲退休或线程池析构）时在该线程上销毁，销毁前调用onRetire；
+// WorkerLocal先销毁时所有值随之销毁，工作线程上的槽在之后创建新值时清理，可以每个作业用一个
+//
+//  WorkerLocal<std::vector<char>> scratch(pool, []{ return std::make_unique<std::vector<char>>(1 << 20); });
+//  WorkerLocal<long> partial(pool, []{ return std::make_unique<long>(0); },
+//                            [&](int, long& v){ retiredSum += v; });
+//  pool.submitTask([&]{ partial.get() += work(scratch.get()); });
+//  ...任务都完成后
+//  partial.forEach([&](int, long& v){ total += v; });
+template<typename T>
+class WorkerLocal
+{
+public:
+    using Factory = std::function<std::unique_ptr<T>()>;
+    using RetireFunc = std::function<void(int, T&)>; // 参数为线程id和即将销毁的值
+
+    explicit WorkerLocal(ThreadPool& pool,
+                         Factory factory = []{ return std::make_unique<T>(); },
+                         RetireFunc onRetire = nullptr)
+        : pool_(&pool)
+        , key_(WorkerContext::generateSlotKey())
+        , state_(std::make_shared<State>())
+    {
+        state_->factory = std::move(factory);
+        state_->onRetire = std::move(onRetire);
+    }
+    // 已创建的值随之销毁，需保证没有任务还在使用
+    ~WorkerLocal() = default;
+
+    WorkerLocal(const WorkerLocal&) = delete;
+    WorkerLocal& operator=(const WorkerLocal&) = delete;
+
+    // 当前工作线程的值，只能在该线程池的任务里调用；同一线程上不加锁
+    T& get()
+    {
+        WorkerContext* context = ThreadPool::currentWorker();
+        if(context == nullptr || context->pool() != pool_)
+        {
+            throw std::logic_error("WorkerLocal::get() called outside a worker of its pool");
+        }
+        void* slot = context->getSlot(key_);
+        if(slot != nullptr)
+        {
+            return *static_cast<T*>(slot);
+        }
+
+        std::unique_ptr<T> value = state_->factory();
+        T* p = value.get();
+        int workerId = context->workerId();
+        {
+            std::lock_guard<std::mutex> lock(state_->mtx);
+            state_->values[workerId] = std::move(value);
+        }
+        std::weak_ptr<State> weak = state_;
+        context->setSlot(key_, p, weak, [weak, workerId]()
+        {
+            if(auto state = weak.lock())
+                state->retire(workerId);
+        });
+        return *p;
+    }
+
+    // 遍历所有仍存活的工作线程的值，用于合并部分结果；应在相关任务都完成后调用
+    void forEach(const std::function<void(int, T&)>& fn)
+    {
+        std::lock_guard<std::mutex> lock(state_->mtx);
+        for(auto& kv : state_->values)
+        {
+            fn(kv.first, *kv.second);
+        }
+    }
+
+    // 已创建的值的个数
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mtx);
+        return state_->values.size();
+    }
+
+private:
+    // 工作线程退出时通过weak_ptr访问，WorkerLocal先销毁时什么也不做
+    struct State
+    {
+        void retire(int workerId)
+        {
+            std::unique_ptr<T> value;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                auto it = values.find(workerId);
+                if(it == values.end())
+                    return;
+                value = std::move(it->second);
+                values.erase(it);
+            }
+            if(onRetire)
+                onRetire(workerId, *value);
+        }
+
+        Factory factory;
+        RetireFunc onRetire;
+        std::mutex mtx;
+        std::map<int, std::unique_ptr<T>> values; // 线程id -> 值
+    };
+
+    ThreadPool* pool_;
+    uint64_t key_;
+    std::shared_ptr<State> state_;
+};
+
+#endif